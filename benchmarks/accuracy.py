@@ -0,0 +1,183 @@
+import argparse
+import json
+import os
+import sys
+import time
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+if ROOT not in sys.path:
+    sys.path.insert(0, ROOT)
+
+PROTOCOLS = ['constant', 'linear', 'cyclic']
+FIELDS = ['sigma_c', 'sigma_e', 'J_c', 'sigma_total']
+# Quadrature with feedback history sums rebuilt at every Picard iteration, as in the original model
+REFERENCE = {'integration': 'quad', 'feedback_mode': 'reference', 'feedback_solver': 'picard',
+             'time_grid': 'uniform'}
+# Fast paths: full settings, the protocols they apply to, the largest error relative to the
+# largest reference value, and the expected exponent of wall time in n_points. Adaptive grids do
+# not follow n_points: they sweep `grid_tols` instead, with wall time fitted against the steps
+# taken and the error expected to fall as grid_tol**order. Feedback solvers only differ from
+# 'incremental' with feedback
+MODES = {
+    'incremental': {'settings': {'integration': 'incremental', 'feedback_mode': 'recursive'},
+                    'protocols': PROTOCOLS, 'tolerance': 1e-3, 'exponent': 1.0},
+    'analytic': {'settings': {'integration': 'analytic', 'feedback_mode': 'recursive'},
+                 'protocols': ['constant', 'linear'], 'tolerance': 1e-6, 'exponent': 1.0},
+    'anderson': {'settings': {'integration': 'incremental', 'feedback_mode': 'recursive',
+                              'feedback_solver': 'anderson'},
+                 'protocols': PROTOCOLS, 'tolerance': 1e-3, 'exponent': 1.0, 'feedback_only': True},
+    'newton': {'settings': {'integration': 'incremental', 'feedback_mode': 'recursive',
+                            'feedback_solver': 'newton'},
+               'protocols': PROTOCOLS, 'tolerance': 1e-3, 'exponent': 1.0, 'feedback_only': True},
+    'adaptive': {'settings': {'integration': 'incremental', 'feedback_mode': 'recursive',
+                              'time_grid': 'adaptive'},
+                 'protocols': PROTOCOLS, 'tolerance': 1e-2, 'exponent': 1.0,
+                 'grid_tols': [1e-2, 1e-3, 1e-4], 'order': 1.0},
+}
+# A fast mode fails scaling when its exponent exceeds the expected one by more than this, and
+# convergence when its order falls short of the expected one by more than this
+EXPONENT_MARGIN = 0.3
+ORDER_MARGIN = 0.3
+# The grid_tol sweep is measured against a run at the smallest tolerance divided by this
+FINE_TOL_FACTOR = 100
+ACCURACY_POINTS = 400
+SCALING_SIZES = [2000, 8000, 32000]
+
+
+def simulate(params, protocol, feedback):
+    from core.models import ConstrainedMixtureModel
+    start = time.perf_counter()
+    results = ConstrainedMixtureModel(params).simulate(protocol, feedback)
+    return results, time.perf_counter() - start
+
+
+def errors(reference, results):
+    # Adaptive runs have their own grid and are interpolated onto the reference one
+    import numpy as np
+    out = {}
+    for name in FIELDS:
+        ref = np.asarray(reference[name], dtype=float)
+        if np.array_equal(results['time'], reference['time']):
+            values = np.asarray(results[name], dtype=float)
+        else:
+            values = np.interp(reference['time'], results['time'], results[name])
+        max_error = float(np.max(np.abs(values - ref)))
+        out[name] = {'max_error': max_error, 'rel_error': max_error / max(float(np.max(np.abs(ref))), 1e-300)}
+    return out
+
+
+def scaling_exponent(sizes, walls):
+    # Least-squares slope of log(wall) over log(n_points)
+    import numpy as np
+    return float(np.polyfit(np.log(sizes), np.log(walls), 1)[0])
+
+
+def grid_tol_scaling(protocol, feedback, mode, repeat):
+    # Errors against a much finer adaptive run rather than the reference, whose own discretisation
+    # error with feedback would mask the decrease at small tolerances
+    settings = {**REFERENCE, **mode['settings']}
+    fine, _ = simulate({**settings, 'grid_tol': min(mode['grid_tols']) / FINE_TOL_FACTOR}, protocol, feedback)
+    steps, walls, rel_errors = [], [], []
+    for tol in mode['grid_tols']:
+        runs = [simulate({**settings, 'grid_tol': tol}, protocol, feedback) for _ in range(repeat)]
+        steps.append(len(runs[0][0]['time']))
+        walls.append(min(wall for _, wall in runs))
+        rel_errors.append(max(max(field['rel_error'] for field in errors(fine, runs[0][0]).values()), 1e-300))
+    exponent = scaling_exponent(steps, walls)
+    order = scaling_exponent(mode['grid_tols'], rel_errors)
+    return {'grid_tols': mode['grid_tols'], 'sizes': steps, 'walls': walls, 'grid_errors': rel_errors,
+            'exponent': exponent, 'expected_exponent': mode['exponent'],
+            'scales': exponent <= mode['exponent'] + EXPONENT_MARGIN,
+            'order': order, 'expected_order': mode['order'], 'converges': order >= mode['order'] - ORDER_MARGIN}
+
+
+def run_case(protocol, feedback, modes, accuracy_points, sizes, repeat, tolerance_scale):
+    base = {'n_points': accuracy_points}
+    reference, reference_wall = simulate({**base, **REFERENCE}, protocol, feedback)
+    case = {'protocol': protocol, 'feedback': feedback, 'reference_wall': reference_wall, 'modes': {}}
+    for name in modes:
+        mode = MODES[name]
+        if protocol not in mode['protocols'] or (mode.get('feedback_only') and not feedback):
+            continue
+        results, wall = simulate({**base, **REFERENCE, **mode['settings']}, protocol, feedback)
+        error = errors(reference, results)
+        tolerance = mode['tolerance'] * tolerance_scale
+        entry = {'wall': wall, 'errors': error, 'tolerance': tolerance,
+                 'accurate': all(field['rel_error'] <= tolerance for field in error.values())}
+
+        if 'grid_tols' in mode:
+            entry.update(grid_tol_scaling(protocol, feedback, mode, repeat))
+        elif len(sizes) > 1:
+            walls = [min(simulate({**REFERENCE, **mode['settings'], 'n_points': n}, protocol, feedback)[1]
+                         for _ in range(repeat)) for n in sizes]
+            exponent = scaling_exponent(sizes, walls)
+            entry.update({'sizes': sizes, 'walls': walls, 'exponent': exponent,
+                          'expected_exponent': mode['exponent'],
+                          'scales': exponent <= mode['exponent'] + EXPONENT_MARGIN})
+        case['modes'][name] = entry
+    return case
+
+
+def print_case(case):
+    label = f"{case['protocol']}{'/feedback' if case['feedback'] else ''}"
+    for name, entry in case['modes'].items():
+        worst = max(entry['errors'].items(), key=lambda item: item[1]['rel_error'])
+        scaling = f"n^{entry['exponent']:.2f}" if 'exponent' in entry else '-'
+        order = f"tol^{entry['order']:.2f}" if 'order' in entry else '-'
+        flags = ('' if entry['accurate'] else ' <-- error') + ('' if entry.get('scales', True) else ' <-- scaling') + \
+                ('' if entry.get('converges', True) else ' <-- order')
+        print(f"{label:<18} {name:<12} {worst[1]['rel_error']:>10.2e} ({worst[0]:<11}) "
+              f"{entry['wall']:>9.4f} s {case['reference_wall'] / entry['wall']:>8.1f}x {scaling:>8} {order:>9}{flags}")
+
+
+def parse_arguments():
+    parser = argparse.ArgumentParser(
+        description="Accuracy and scaling of the fast solver modes against the quad/Picard reference",
+        formatter_class=argparse.ArgumentDefaultsHelpFormatter
+    )
+    parser.add_argument('--modes', nargs='+', choices=list(MODES), default=list(MODES),
+                        help="Fast modes to check")
+    parser.add_argument('--protocols', nargs='+', choices=PROTOCOLS, default=PROTOCOLS,
+                        help="Protocols to run, each with and without feedback")
+    parser.add_argument('--accuracy_points', type=int, default=ACCURACY_POINTS,
+                        help="n_points of the comparison with the reference")
+    parser.add_argument('--sizes', type=int, nargs='+', default=SCALING_SIZES,
+                        help="n_points values of the scaling fit")
+    parser.add_argument('--repeat', type=int, default=3,
+                        help="Timed runs per size; the fastest is used")
+    parser.add_argument('--tolerance_scale', type=float, default=1.0,
+                        help="Factor applied to every mode's error tolerance")
+    parser.add_argument('--output', type=str,
+                        help="Write the results as JSON to this file")
+    return parser.parse_args()
+
+
+def main():
+    args = parse_arguments()
+    from benchmarks.run import metadata
+
+    print(f"{'case':<18} {'mode':<12} {'rel error':>10} {'(field)':<13} {'wall':>11} {'speedup':>9} {'scaling':>8} "
+          f"{'order':>9}")
+    report = {'meta': metadata(), 'reference': REFERENCE, 'cases': []}
+    for protocol in args.protocols:
+        for feedback in (False, True):
+            case = run_case(protocol, feedback, args.modes, args.accuracy_points, args.sizes, args.repeat,
+                            args.tolerance_scale)
+            report['cases'].append(case)
+            print_case(case)
+
+    if args.output:
+        with open(args.output, 'w') as f:
+            json.dump(report, f, indent=2)
+
+    failures = [f"{case['protocol']}{'/feedback' if case['feedback'] else ''}/{name}"
+                for case in report['cases'] for name, entry in case['modes'].items()
+                if not entry['accurate'] or not entry.get('scales', True) or not entry.get('converges', True)]
+    if failures:
+        print(f"\n{len(failures)} mode(s) beyond tolerance, expected scaling or order: {', '.join(failures)}")
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,271 @@
+import argparse
+import json
+import os
+import platform
+import subprocess
+import sys
+import time
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+if ROOT not in sys.path:
+    sys.path.insert(0, ROOT)
+
+SIZES = [100, 1000, 10000, 100000, 1000000]
+PROTOCOLS = ['constant', 'linear', 'cyclic']
+# Documented bound of float32 storage: largest error of any series relative to its largest
+# float64 value. Everything is computed in float64, so only the rounding of the stored values
+# (2**-24 each) and of the float32 totals remains
+FLOAT32_BOUND = 8 * 2**-24
+# Target wall time [s] of a tiny CLI run in a fresh interpreter, imports included, and the
+# modules the CLI and library must not load
+STARTUP_TARGET = 1.0
+GUI_MODULES = ('matplotlib', 'PyQt5', 'pandas')
+
+
+def case_name(case):
+    if case['kind'] == 'startup':
+        return 'startup/cli'
+    parts = [case['kind']]
+    if case['kind'] == 'simulate':
+        parts.append(case['protocol'])
+    parts.append(case['integration'])
+    if case['feedback']:
+        parts.append('feedback')
+    parts.append(f"n={case['n_points']}")
+    return '/'.join(parts)
+
+
+def build_cases(sizes, integrations, max_quad_points, feedback_max_points):
+    cases = [{'kind': 'startup', 'feedback': False, 'integration': 'auto', 'n_points': 10}]
+    for n in sizes:
+        for integration in integrations:
+            if integration == 'quad' and n > max_quad_points:
+                continue
+            for feedback in (False, True):
+                if feedback and n > feedback_max_points:
+                    continue
+                for protocol in PROTOCOLS:
+                    cases.append({'kind': 'simulate', 'protocol': protocol, 'feedback': feedback,
+                                  'integration': integration, 'n_points': n})
+                cases.append({'kind': 'all_protocols', 'feedback': feedback,
+                              'integration': integration, 'n_points': n})
+            cases.append({'kind': 'cli', 'feedback': False, 'integration': integration, 'n_points': n})
+    return cases
+
+
+def peak_rss_mb():
+    try:
+        import resource
+    except ImportError:
+        return None
+    peak = resource.getrusage(resource.RUSAGE_SELF).ru_maxrss
+    # Linux reports kilobytes, macOS bytes
+    return peak / (1024 * 1024) if sys.platform == 'darwin' else peak / 1024
+
+
+def run_case(case):
+    # Runs in a fresh interpreter so that peak RSS belongs to this case alone
+    if case['kind'] == 'startup':
+        # main.py as the pipelines launch it; the interpreter itself is in process_wall
+        start = time.perf_counter()
+        import main
+        sys.argv = ['main.py', '--mode', 'cli', 'constant', '--quiet', '--n_points', str(case['n_points'])]
+        main.main()
+        wall = time.perf_counter() - start
+        return {'wall': wall, 'steps': case['n_points'], 'steps_per_sec': case['n_points'] / wall,
+                'peak_rss_mb': peak_rss_mb(), 'gui_modules': [name for name in GUI_MODULES if name in sys.modules]}
+
+    from core.models import ConstrainedMixtureModel
+
+    params = {'n_points': case['n_points'], 'integration': case['integration']}
+    start = time.perf_counter()
+    if case['kind'] == 'simulate':
+        ConstrainedMixtureModel(params).simulate(case['protocol'], case['feedback'])
+        steps = case['n_points']
+    elif case['kind'] == 'all_protocols':
+        ConstrainedMixtureModel(params).simulate_all_protocols(case['feedback'])
+        steps = case['n_points'] * len(PROTOCOLS)
+    else:
+        from ui import cli
+        sys.argv = ['cli', 'all', '--quiet', '--n_points', str(case['n_points']),
+                    '--integration', case['integration']]
+        cli.main()
+        steps = case['n_points'] * len(PROTOCOLS)
+    wall = time.perf_counter() - start
+    return {'wall': wall, 'steps': steps, 'steps_per_sec': steps / wall if wall > 0 else None,
+            'peak_rss_mb': peak_rss_mb()}
+
+
+def measure(case, repeat, timeout):
+    runs = []
+    for _ in range(repeat):
+        start = time.perf_counter()
+        try:
+            proc = subprocess.run([sys.executable, '-m', 'benchmarks.run', '--worker', json.dumps(case)],
+                                  cwd=ROOT, capture_output=True, text=True, timeout=timeout)
+        except subprocess.TimeoutExpired:
+            return {**case, 'name': case_name(case), 'status': 'timeout', 'timeout': timeout}
+        if proc.returncode != 0:
+            lines = proc.stderr.strip().splitlines()
+            return {**case, 'name': case_name(case), 'status': 'error',
+                    'error': lines[-1] if lines else f"exit code {proc.returncode}"}
+        run = json.loads(proc.stdout.strip().splitlines()[-1])
+        run['process_wall'] = time.perf_counter() - start
+        runs.append(run)
+
+    # The fastest repeat is the least disturbed by the rest of the machine
+    best = min(runs, key=lambda run: run['wall'])
+    return {**case, 'name': case_name(case), 'status': 'ok', 'repeat': repeat, **best,
+            'peak_rss_mb': max((run['peak_rss_mb'] or 0) for run in runs) or None}
+
+
+def precision_errors(sizes, integrations):
+    # float32 storage against the float64 reference, in process: errors are deterministic
+    import numpy as np
+    from core.models import ConstrainedMixtureModel
+    from core.results import RESULT_FIELDS
+
+    errors = []
+    for n in sizes:
+        for integration in integrations:
+            for feedback in (False, True):
+                for protocol in PROTOCOLS:
+                    params = {'n_points': n, 'integration': integration}
+                    reference = ConstrainedMixtureModel(params).simulate(protocol, feedback)
+                    single = ConstrainedMixtureModel({**params, 'dtype': 'float32'}).simulate(protocol, feedback)
+                    error = max(float(np.max(np.abs(single[name] - reference[name])) /
+                                      max(float(np.max(np.abs(reference[name]))), 1e-300))
+                                for name in RESULT_FIELDS)
+                    case = {'kind': 'simulate', 'protocol': protocol, 'feedback': feedback,
+                            'integration': integration, 'n_points': n}
+                    errors.append({'name': case_name(case), 'max_rel_error': error})
+    return errors
+
+
+def git_revision():
+    try:
+        return subprocess.run(['git', 'rev-parse', '--short', 'HEAD'], cwd=ROOT, capture_output=True,
+                              text=True, timeout=10).stdout.strip() or None
+    except (OSError, subprocess.SubprocessError):
+        return None
+
+
+def metadata():
+    import numpy
+    import scipy
+    return {'revision': git_revision(), 'timestamp': time.strftime('%Y-%m-%dT%H:%M:%S'),
+            'python': platform.python_version(), 'numpy': numpy.__version__, 'scipy': scipy.__version__,
+            'platform': platform.platform(), 'cpus': os.cpu_count()}
+
+
+def compare(baseline, current, threshold):
+    # Cases slower than threshold x baseline wall time count as regressions
+    base = {result['name']: result for result in baseline['results'] if result['status'] == 'ok'}
+    regressions = []
+    print(f"{'case':<48} {'base [s]':>10} {'new [s]':>10} {'ratio':>7}")
+    for result in current['results']:
+        if result['name'] not in base:
+            continue
+        if result['status'] != 'ok':
+            print(f"{result['name']:<48} {base[result['name']]['wall']:>10.4f} {result['status']:>10}")
+            regressions.append(result['name'])
+            continue
+        ratio = result['wall'] / base[result['name']]['wall']
+        flag = ' <-- slower' if ratio > threshold else ''
+        print(f"{result['name']:<48} {base[result['name']]['wall']:>10.4f} {result['wall']:>10.4f} {ratio:>7.2f}{flag}")
+        if ratio > threshold:
+            regressions.append(result['name'])
+    return regressions
+
+
+def parse_arguments():
+    parser = argparse.ArgumentParser(
+        description="Benchmarks of the CMM model kernels",
+        formatter_class=argparse.ArgumentDefaultsHelpFormatter
+    )
+    parser.add_argument('--sizes', type=int, nargs='+', default=SIZES,
+                        help="n_points values to run")
+    parser.add_argument('--integration', nargs='+', choices=['quad', 'incremental'],
+                        default=['quad', 'incremental'], help="Integration modes to run")
+    parser.add_argument('--max_quad_points', type=int, default=10000,
+                        help="Largest n_points run with quadrature (one quad call per step)")
+    parser.add_argument('--feedback_max_points', type=int, default=100000,
+                        help="Largest n_points run with mechanical feedback")
+    parser.add_argument('--repeat', type=int, default=3,
+                        help="Runs per case; the fastest is reported")
+    parser.add_argument('--timeout', type=float, default=600,
+                        help="Seconds before a case is recorded as a timeout")
+    parser.add_argument('--filter', type=str,
+                        help="Only run cases whose name contains this text")
+    parser.add_argument('--output', type=str,
+                        help="Write the results as JSON to this file")
+    parser.add_argument('--compare', type=str,
+                        help="Baseline JSON to compare against; exits with 1 on regressions")
+    parser.add_argument('--threshold', type=float, default=1.25,
+                        help="Wall time ratio above which a case counts as a regression")
+    parser.add_argument('--precision', action='store_true',
+                        help="Instead of timing, compare float32 storage against float64; exits "
+                             "with 1 if an error exceeds the documented bound")
+    parser.add_argument('--startup_target', type=float, default=STARTUP_TARGET,
+                        help="Seconds a tiny CLI run may take from interpreter start; exits with 1 "
+                             "above it or if the CLI loads matplotlib, PyQt5 or pandas")
+    parser.add_argument('--worker', type=str, help=argparse.SUPPRESS)
+    return parser.parse_args()
+
+
+def main():
+    args = parse_arguments()
+    if args.worker:
+        print(json.dumps(run_case(json.loads(args.worker))))
+        return 0
+
+    if args.precision:
+        sizes = [n for n in args.sizes if n <= args.max_quad_points]
+        errors = precision_errors(sizes, args.integration)
+        for result in errors:
+            flag = ' <-- above bound' if result['max_rel_error'] > FLOAT32_BOUND else ''
+            print(f"{result['name']:<48} {result['max_rel_error']:>10.2e}{flag}")
+        if args.output:
+            with open(args.output, 'w') as f:
+                json.dump({'meta': metadata(), 'bound': FLOAT32_BOUND, 'precision': errors}, f, indent=2)
+        return 1 if any(result['max_rel_error'] > FLOAT32_BOUND for result in errors) else 0
+
+    cases = build_cases(args.sizes, args.integration, args.max_quad_points, args.feedback_max_points)
+    if args.filter:
+        cases = [case for case in cases if args.filter in case_name(case)]
+
+    report = {'meta': metadata(), 'results': []}
+    for case in cases:
+        result = measure(case, args.repeat, args.timeout)
+        report['results'].append(result)
+        if result['status'] == 'ok':
+            print(f"{result['name']:<48} {result['wall']:>10.4f} s {result['steps_per_sec']:>12.0f} steps/s "
+                  f"{result['peak_rss_mb'] or 0:>8.1f} MB")
+        else:
+            print(f"{result['name']:<48} {result['status']}")
+
+    if args.output:
+        with open(args.output, 'w') as f:
+            json.dump(report, f, indent=2)
+
+    status = 0
+    for result in report['results']:
+        if result['kind'] != 'startup' or result['status'] != 'ok':
+            continue
+        if result['process_wall'] > args.startup_target or result['gui_modules']:
+            print(f"\nStartup {result['process_wall']:.3f} s (target {args.startup_target:g} s)"
+                  f"{', loads ' + ', '.join(result['gui_modules']) if result['gui_modules'] else ''}")
+            status = 1
+
+    if args.compare:
+        with open(args.compare) as f:
+            baseline = json.load(f)
+        regressions = compare(baseline, report, args.threshold)
+        if regressions:
+            print(f"\n{len(regressions)} case(s) slower than {args.threshold}x the baseline")
+            return 1
+    return status
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,107 @@
+import hashlib
+import json
+import os
+from collections import OrderedDict
+import numpy as np
+from core.constans import DEFAULT_PARAMS
+
+# Model parameters that do not change the results; the time grid is hashed on its own
+CACHE_IGNORED_PARAMS = ('time', 'profile')
+# Completed entries that are neither defaults nor derived constants (synthesis fluxes)
+CACHE_COMPLETED_PARAMS = ('j_cplus', 'j_eplus')
+# Result sets kept in memory before the least recently used one is dropped
+CACHE_MEMORY_ENTRIES = 32
+
+
+def _encode(value):
+    # Canonical bytes for the hash: equal values give equal bytes across runs and platforms
+    if value is None or isinstance(value, (bool, str)):
+        return repr(value).encode()
+    if isinstance(value, (int, float, np.number)) and np.ndim(value) == 0 and not np.iscomplexobj(value):
+        return repr(float(value)).encode()
+    if isinstance(value, (list, tuple)) and all(isinstance(item, str) for item in value):
+        return repr(tuple(value)).encode()
+    if np.iscomplexobj(value):
+        array = np.ascontiguousarray(value, dtype=complex)
+        return f"complex{array.shape}".encode() + array.astype('<c16').tobytes()
+    array = np.ascontiguousarray(value, dtype=float)
+    return f"array{array.shape}".encode() + array.astype('<f8').tobytes()
+
+
+class ResultCache:
+    # Results of simulate() keyed by a hash of the completed parameters, the time grid, the protocol
+    # and the feedback flag. Kept in memory (LRU) and, with `directory`, as .npz files there
+    def __init__(self, directory=None, max_entries=CACHE_MEMORY_ENTRIES):
+        self.directory = directory
+        self.max_entries = max_entries
+        self._entries = OrderedDict()
+        self.hits = 0
+        self.misses = 0
+        if directory:
+            os.makedirs(directory, exist_ok=True)
+
+    def key(self, params, protocol, feedback, time):
+        # Only model parameters and their derived entries: anything else passed along with them
+        # (CLI options such as vars(args)) does not describe the simulation
+        from core.parameters import DERIVED_PARAMS
+        hashed = (set(DEFAULT_PARAMS) | set(DERIVED_PARAMS) | set(CACHE_COMPLETED_PARAMS)) - set(CACHE_IGNORED_PARAMS)
+        digest = hashlib.sha256()
+        for name in sorted(params):
+            if name not in hashed:
+                continue
+            digest.update(name.encode() + b'=' + _encode(params[name]) + b';')
+        digest.update(b'time=' + _encode(time) + b';')
+        digest.update(f"protocol={protocol};feedback={bool(feedback)}".encode())
+        return digest.hexdigest()
+
+    def get(self, key):
+        if key in self._entries:
+            self._entries.move_to_end(key)
+            self.hits += 1
+            return dict(self._entries[key])
+        path = self._path(key)
+        if path is not None and os.path.exists(path):
+            with np.load(path) as data:
+                results = {name: data[name] for name in data.files}
+            self._remember(key, results)
+            self.hits += 1
+            return dict(results)
+        self.misses += 1
+        return None
+
+    def put(self, key, results, meta=None):
+        # The cache keeps its own copy, read-only since every hit shares it; the caller's results
+        # stay writable. `meta` (protocol, feedback, scalar parameters) is written beside the
+        # file as <key>.json for run browsers
+        results = {name: np.array(values) if isinstance(values, np.ndarray) else values
+                   for name, values in results.items() if not name.startswith('_')}
+        for values in results.values():
+            if isinstance(values, np.ndarray):
+                values.setflags(write=False)
+        self._remember(key, results)
+        path = self._path(key)
+        if path is not None and not os.path.exists(path):
+            tmp = path + '.tmp.npz'
+            np.savez(tmp, **results)
+            os.replace(tmp, path)
+            if meta is not None:
+                tmp = path[:-len('.npz')] + '.json.tmp'
+                with open(tmp, 'w') as f:
+                    json.dump(meta, f, indent=2)
+                os.replace(tmp, path[:-len('.npz')] + '.json')
+
+    def clear(self):
+        self._entries.clear()
+
+    def __contains__(self, key):
+        path = self._path(key)
+        return key in self._entries or (path is not None and os.path.exists(path))
+
+    def _remember(self, key, results):
+        self._entries[key] = results
+        self._entries.move_to_end(key)
+        while len(self._entries) > self.max_entries:
+            self._entries.popitem(last=False)
+
+    def _path(self, key):
+        return os.path.join(self.directory, f"{key}.npz") if self.directory else None
@@ -33,6 +33,14 @@ DEFAULT_PARAMS = {
     't_end': 10.0, # Simulation time [days]
     'n_points': 1000, # Number of sampling points
     'epsilon': 1e-4, # Iteration convergence criterion
+    'integration': 'auto', # Hereditary integrals: 'auto', 'analytic', 'quad' or 'incremental'
+    'feedback_mode': 'recursive', # Feedback history sums: 'recursive' or 'reference'
+    'feedback_solver': 'picard', # Feedback step iteration: 'picard', 'anderson' or 'newton'
+    'max_iter': 20, # Iteration limit of each feedback step
+    'time_grid': 'uniform', # 'uniform' (n_points) or 'adaptive'
+    'grid_tol': 1e-3, # Relative interpolation tolerance of adaptive grids
+    'profile': False, # Collect per-phase timers and counters into results['_stats']
+    'dtype': 'float64', # Result storage: 'float64' or 'float32' (computation stays float64)
     
    # Cyclic stretching parameters
     'omega': np.pi, # Frequency for cyclic mode (π from sin(πt))
@@ -42,36 +50,10 @@ J0 = 1.0
 DEFAULT_TIME = np.linspace(0, DEFAULT_PARAMS['t_end'], DEFAULT_PARAMS['n_points'])
 
 def get_parameters(overrides=None):
-    params = DEFAULT_PARAMS.copy()
-    
-    if overrides:
-        params.update(overrides)
-
-    params['J0'] = 1.0 
-    params['Jc0'] = params['fi0_c']
-    params['Je0'] = params['fi0_e']
-    params['Jg0'] = params['fi0_g']
-    
-    params['j_cplus'] = params['k_cplus'] * params['Jc0']
-    params['j_eplus'] = params['k_eplus'] * params['Je0']
-    
-    if params['sigma0_c'] is None:
-        Gx_c0 = params['Jc0'] ** (1.0 / (1.0 + 2.0 * params['gamma']))
-        lambda_c0 = params['lambda0_c'] * Gx_c0 / Gx_c0  # = lambda0_c
-        sigma_c_roof_0 = (4 * params['c_c'] * (lambda_c0**2) * 
-                         (lambda_c0**2 - 1) * 
-                         np.exp(params['alpha_c'] * (lambda_c0**2 - 1)**2))
-        params['sigma0_c'] = (params['Jc0'] / params['J0']) * sigma_c_roof_0
-    
-    if params['k_cminus'] == 0 and params['k_cplus'] != 0:
-        raise ValueError("k_cminus cannot be 0 when k_cplus != 0")
+    # The same completion as ConstrainedMixtureModel, see core.parameters.Parameters
+    from core.parameters import Parameters
     
+    params = Parameters(overrides)
     if params['a'] <= 0:
         raise ValueError("Parameter 'a' must be > 0")
-    
-    if 'omega' not in params:
-        params['omega'] = np.pi 
-    
-    params['time'] = np.linspace(0, params['t_end'], params['n_points'])
-    
     return params
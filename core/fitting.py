@@ -0,0 +1,167 @@
+import os
+from concurrent.futures import ProcessPoolExecutor
+import numpy as np
+from scipy.optimize import least_squares
+from core.models import ConstrainedMixtureModel
+from core.protocols import install_protocol, protocol_spec
+
+# Parameters fitted unless others are named
+FIT_PARAMS = ('c_c', 'alpha_c', 'k_cplus', 'K_cplus')
+# Random starts are drawn log-uniformly within this factor of the initial values
+START_SPREAD = 4.0
+
+
+class StressObjective:
+    # Weighted residuals sigma_total(t_data) - stress of one parameter vector. The model, its time
+    # grid, the interpolation onto the data times and the residual and Jacobian buffers are set up
+    # once and reused by every evaluation
+    def __init__(self, params, protocol, time, stress, fit_params=FIT_PARAMS, feedback=False,
+                 weights=None, jacobian='sensitivity'):
+        if jacobian not in ('sensitivity', '2-point', '3-point'):
+            raise ValueError(f"Unknown jacobian: {jacobian}")
+        time = np.asarray(time, dtype=float)
+        stress = np.asarray(stress, dtype=float)
+        if time.ndim != 1 or time.shape != stress.shape or len(time) < 2:
+            raise ValueError("time and stress must be 1-D arrays of the same length")
+
+        self.protocol = protocol
+        self.feedback = feedback
+        self.names = list(fit_params)
+        self.jacobian = jacobian
+        self.base = {'t_end': float(time.max()), **(params or {})}
+        self.model = ConstrainedMixtureModel(self.base)
+        unknown = [name for name in self.names if name not in self.model.params]
+        if unknown:
+            raise ValueError(f"Unknown parameters: {', '.join(unknown)}")
+        if jacobian == 'sensitivity':
+            # Residuals and their derivatives must come from the same (complex-safe) evaluation
+            if protocol != 'constant' and self.model._integration_mode(protocol) == 'quad':
+                self.base['integration'] = 'incremental'
+            self.base['feedback_mode'] = 'recursive'
+            self.model = ConstrainedMixtureModel(self.base)
+
+        # The grid is fixed at the initial parameters, so every evaluation samples the same points
+        self.grid = self.model._time_grid(protocol)
+        if time.min() < self.grid[0] or time.max() > self.grid[-1]:
+            raise ValueError(f"Data times must lie within [0, {self.grid[-1]:g}]")
+        self._index = np.clip(np.searchsorted(self.grid, time, side='right') - 1, 0, len(self.grid) - 2)
+        self._weight = (time - self.grid[self._index]) / (self.grid[self._index + 1] - self.grid[self._index])
+        self.stress = stress
+        self.weights = np.ones_like(stress) if weights is None else np.broadcast_to(weights, stress.shape)
+        self.residuals = np.empty_like(stress)
+        self.jac = np.empty((len(stress), len(self.names)))
+        self.evaluations = 0
+        self._x = None
+        self._x_jac = None
+
+    def x0(self):
+        return np.array([float(self.model.params[name]) for name in self.names])
+
+    # least_squares keeps the residuals and Jacobian of accepted points while it tries others,
+    # so it is handed copies of the buffers
+    def residual(self, x):
+        if self._x is None or not np.array_equal(x, self._x):
+            self._set(x)
+            if self.jacobian == 'sensitivity':
+                self._evaluate_sensitivity(x)
+            else:
+                self._sample(self.model._run_protocol(self.protocol, self.feedback, self.grid)['sigma_total'],
+                             self.residuals)
+                self._finish_residuals()
+                self._x = np.array(x, dtype=float)
+        return self.residuals.copy()
+
+    def jacobian_matrix(self, x):
+        # Asked for at the point whose residuals were just taken, which already computed it
+        if self._x_jac is None or not np.array_equal(x, self._x_jac):
+            self._set(x)
+            self._evaluate_sensitivity(x)
+        return self.jac.copy()
+
+    def _set(self, x):
+        self.model.user_params = {**self.base, **dict(zip(self.names, np.asarray(x, dtype=float).tolist()))}
+        self.model.params = self.model._validate_and_complete_params(self.model.user_params)
+        self.evaluations += 1
+
+    def _evaluate_sensitivity(self, x):
+        # One batched run gives the residuals and all their derivatives
+        results = self.model.sensitivity(self.protocol, self.feedback, self.names)
+        self._sample(results['sigma_total'], self.residuals)
+        self._finish_residuals()
+        self._sample(results['jacobian']['sigma_total'], self.jac)
+        self.jac *= self.weights[:, None]
+        self._x = self._x_jac = np.array(x, dtype=float)
+
+    def _finish_residuals(self):
+        self.residuals -= self.stress
+        self.residuals *= self.weights
+
+    def _sample(self, values, out):
+        # Linear interpolation along the first axis from the grid to the data times
+        weight = self._weight.reshape((-1,) + (1,) * (values.ndim - 1))
+        np.multiply(values[self._index], 1 - weight, out=out)
+        out += values[self._index + 1] * weight
+
+
+def start_points(x0, count, lower, upper, seed=None):
+    # The initial values first, then random candidates around them inside the bounds
+    rng = np.random.default_rng(seed)
+    x0 = np.asarray(x0, dtype=float)
+    points = [x0]
+    for _ in range(count - 1):
+        low = np.where(x0 > 0, x0 / START_SPREAD, 0.0)
+        high = np.where(x0 > 0, x0 * START_SPREAD, 1.0)
+        point = np.where(x0 > 0, np.exp(rng.uniform(np.log(np.maximum(low, 1e-300)), np.log(high))),
+                         rng.uniform(low, high))
+        points.append(np.clip(point, lower, upper))
+    return points
+
+
+def _fit_start(config, x0):
+    install_protocol(config['protocol'])
+    objective = StressObjective(**config['objective'])
+    jac = objective.jacobian_matrix if objective.jacobian == 'sensitivity' else objective.jacobian
+    solution = least_squares(objective.residual, x0, jac=jac, bounds=config['bounds'],
+                             x_scale='jac', max_nfev=config['max_nfev'])
+    return {'x0': np.asarray(x0), 'x': solution.x, 'params': dict(zip(objective.names, solution.x.tolist())),
+            'cost': float(solution.cost), 'success': bool(solution.success), 'message': solution.message,
+            'evaluations': objective.evaluations}
+
+
+class ParameterFit:
+    # Least-squares fit of model parameters to a measured stress curve. Each start runs
+    # least_squares on one StressObjective; starts are spread over `jobs` processes. A second
+    # fit() starts from the best parameters of the previous one
+    def __init__(self, params, protocol, time, stress, fit_params=FIT_PARAMS, feedback=False,
+                 weights=None, bounds=None, jacobian='sensitivity'):
+        self.objective_config = {'params': dict(params or {}), 'protocol': protocol, 'time': time,
+                                 'stress': stress, 'fit_params': tuple(fit_params), 'feedback': feedback,
+                                 'weights': weights, 'jacobian': jacobian}
+        self.names = list(fit_params)
+        bounds = bounds or {}
+        self.lower = np.array([bounds.get(name, (0.0, np.inf))[0] for name in self.names], dtype=float)
+        self.upper = np.array([bounds.get(name, (0.0, np.inf))[1] for name in self.names], dtype=float)
+        self.x0 = StressObjective(**self.objective_config).x0()
+        self.best = None
+
+    def fit(self, starts=1, jobs=1, seed=None, max_nfev=None):
+        x0 = self.best['x'] if self.best is not None else self.x0
+        points = start_points(np.clip(x0, self.lower, self.upper), starts, self.lower, self.upper, seed)
+        config = {'objective': self.objective_config, 'bounds': (self.lower, self.upper), 'max_nfev': max_nfev,
+                  'protocol': protocol_spec(self.objective_config['protocol'])}
+
+        jobs = jobs or os.cpu_count() or 1
+        if jobs <= 1 or len(points) <= 1:
+            runs = [_fit_start(config, point) for point in points]
+        else:
+            with ProcessPoolExecutor(max_workers=min(jobs, len(points))) as pool:
+                runs = list(pool.map(_fit_start, [config] * len(points), points))
+
+        best = min(runs, key=lambda run: run['cost'])
+        self.best = {**best, 'starts': runs}
+        return self.best
+
+
+def fit(params, protocol, time, stress, fit_params=FIT_PARAMS, feedback=False, starts=1, jobs=1,
+        seed=None, **kwargs):
+    return ParameterFit(params, protocol, time, stress, fit_params, feedback, **kwargs).fit(starts, jobs, seed)
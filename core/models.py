@@ -1,273 +1,1257 @@
+import itertools
+import contextlib
+import copy
+import math
+from time import perf_counter
 import numpy as np
 from scipy import integrate
-from scipy.optimize import fsolve
-import matplotlib.pyplot as plt
+from core.parameters import Parameters
+from core.protocols import BUILTIN_PROTOCOLS, get_protocol
+from core.results import RESULT_FIELDS, SimulationResults
+
+# Interpolation nodes used to split non-separable hereditary integrands
+CHEBYSHEV_NODES = 16
+# Largest k*(t - t_start) accumulated before _decayed_cumsum rescales
+MAX_DECAY_SPAN = 50.0
+# Parameters that define the time grid or the solver and cannot vary inside one batch
+BATCH_FIXED_PARAMS = ('t_end', 'n_points', 'integration', 'feedback_mode', 'feedback_solver', 'max_iter',
+                      'protocol', 'epsilon')
+# Progress reports per phase of a simulation
+PROGRESS_UPDATES = 100
+# Adaptive grids never take steps longer than t_end / MIN_ADAPTIVE_STEPS
+MIN_ADAPTIVE_STEPS = 20
+# Time steps per block yielded by simulate_iter
+STREAM_CHUNK_SIZE = 10000
+# Blocks a simulate(on_chunk=...) run is split into
+LIVE_BLOCKS = 100
+# Parameters differentiated by sensitivity() unless others are named
+SENSITIVITY_PARAMS = ('c_c', 'c_e', 'c_g', 'k_cplus', 'k_cminus', 'alpha_c', 'K_cplus')
+# Imaginary perturbation of the complex-step derivative; no subtraction, so it can be tiny
+COMPLEX_STEP = 1e-20
+# simulate_periodic: steps per resolved cycle, relative second difference between consecutive
+# cycles below which the response counts as periodic, relative error allowed for one
+# extrapolated jump, and the longest jump in cycles
+PERIODIC_POINTS = 64
+PERIODIC_TOL = 1e-6
+PERIODIC_DRIFT_TOL = 1e-4
+PERIODIC_MAX_SKIP = 10000
+# Storage of the result series (params['dtype']). The integrals, history sums and feedback
+# iterations are computed in float64 whatever the storage
+RESULT_DTYPES = {'float64': np.float64, 'float32': np.float32}
+
+
+def _scalar_params(params):
+    # JSON-ready parameters for result metadata; arrays such as the time grid are left out
+    scalars = {}
+    for name, value in params.items():
+        if isinstance(value, np.generic):
+            value = value.item()
+        if value is None or isinstance(value, (bool, int, float, str)):
+            scalars[name] = value
+    return scalars
+
+
+def _working(values):
+    # Series entering a recursion are promoted to at least float64
+    return np.asarray(values, dtype=np.result_type(values, np.float64))
+
+
+class SimulationCancelled(Exception):
+    pass
+
+
+class SimulationStats:
+    # Timers [s] and counters collected by one protocol run when params['profile'] is set
+    def __init__(self):
+        self.timers = {}
+        self.counters = {}
+        self.iterations = []
+
+    @contextlib.contextmanager
+    def timer(self, name):
+        start = perf_counter()
+        try:
+            yield
+        finally:
+            self.timers[name] = self.timers.get(name, 0.0) + perf_counter() - start
+
+    def count(self, name, n=1):
+        self.counters[name] = self.counters.get(name, 0) + n
+
+    def as_dict(self):
+        return {'timers': dict(self.timers), 'counters': dict(self.counters),
+                'feedback_iterations': np.array(self.iterations, dtype=int)}
+
 
 class ConstrainedMixtureModel:
     def __init__(self, params=None):
+        self.user_params = dict(params or {})
         self.params = self._validate_and_complete_params(params)
         self.results = {}
         self.all_protocol_results = {}
-        if 'j_cplus' not in self.params:
-            self.params['j_cplus'] = self.params['k_cplus'] * self.params['Jc0']
-        if 'j_eplus' not in self.params:
-            self.params['j_eplus'] = self.params['k_eplus'] * self.params['Je0']
+        # Called as progress_callback(phase, fraction, partial_results) from inside simulate
+        self.progress_callback = None
+        # Optional core.cache.ResultCache consulted by simulate
+        self.cache = None
+        self._cancel_requested = False
+        self._adaptive_grids = {}
+        # Grids joined by continue_to, per protocol: ((t_end, n_points, time_grid), grid)
+        self._continued_grids = {}
+        self._growth_tables = {}
+        self._stats = None
+        # Protocol, feedback flag and carried state of the last simulate(), for continue_to
+        self._checkpoint = None
 
     def _validate_and_complete_params(self, params):
-        default_params = {
-            # Mechanical properties
-            'c_c': 1.0, 'c_e': 50.0, 'c_g': 10.0,
-            # Initial volume fractions
-            'fi0_c': 0.75, 'fi0_e': 0.05, 'fi0_g': 0.20,
-            # Remodeling parameters
-            'k_cplus': 1.0, 'k_cminus': 1.0, 'k_eplus': 1.0, 'k_eminus': 1.0,
-            # Stretching parameters
-            'lambda0_c': 1.05, 'lambda0_e': 1.10, 'lambda_roof': 1.1, 'a': 0.1,
-            # Mechanical feedback
-            'K_cplus': 0.04, 'sigma0_c': None,
-            # Numerical parameters
-            'alpha_c': 0.01, 'gamma': 1.0, 't_end': 10.0, 'n_points': 1000
-        }
-        
-        complete_params = {**default_params, **(params or {})}
-        
-        # Automatic calculation of derived parameters
-        complete_params['time'] = np.linspace(0, complete_params['t_end'], 
-                                           complete_params['n_points'])
-        complete_params['J0'] = 1.0
-        complete_params['Jc0'] = complete_params['fi0_c']
-        complete_params['Je0'] = complete_params['fi0_e']
-        complete_params['Jg0'] = complete_params['fi0_g']
-        
-       # Calculation of homeostatic tension
-        if complete_params['sigma0_c'] is None:
-            Gx_c0 = complete_params['Jc0']**(1/(1 + 2*complete_params['gamma']))
-            lambda_c0 = complete_params['lambda0_c']
-            sigma_c_roof = self._sigma_c_roof(lambda_c0)
-            complete_params['sigma0_c'] = (complete_params['Jc0']/complete_params['J0']) * sigma_c_roof
-        
-        return complete_params
+        # Defaults, derived constants and the homeostatic tension, see core.parameters
+        return Parameters(params)
 
-    def simulate_all_protocols(self, feedback=False):
+    def simulate_all_protocols(self, feedback=False, jobs=1, on_chunk=None):
         protocols = ['constant', 'linear', 'cyclic']
         self.all_protocol_results = {}
         
+        if jobs != 1:
+            from core.parallel import ParallelRunner
+            self.all_protocol_results = ParallelRunner(jobs).run_protocols(
+                self.user_params, feedback, protocols)
+            return self.all_protocol_results
+        
         for protocol in protocols:
-            self.all_protocol_results[protocol] = self.simulate(protocol, feedback)
+            self.all_protocol_results[protocol] = self.simulate(protocol, feedback, on_chunk)
         
         return self.all_protocol_results
 
-    def simulate(self, protocol, feedback=False):
-        protocol_funcs = {
-            'constant': self._constant_protocol,
-            'linear': self._linear_protocol,
-            'cyclic': self._cyclic_protocol
-        }
+    def simulate(self, protocol, feedback=False, on_chunk=None):
+        # With on_chunk, the grid is run in LIVE_BLOCKS consecutive blocks and on_chunk receives
+        # views of the finished part of the results after each one
+        try:
+            key = None
+            # Profiled runs are always computed, their stats describe this call
+            if self.cache is not None and not self.params['profile']:
+                key = self.cache_key(protocol, feedback)
+                results = self.cache.get(key)
+                if results is not None:
+                    self.results = results
+                    self._checkpoint = {'protocol': protocol, 'feedback': feedback, 'state': None}
+                    return results
+            self._checkpoint = None
+            # The reference feedback rebuilds the whole history and cannot carry state
+            state = None if feedback and self.params['feedback_mode'] == 'reference' else {}
+            if on_chunk is None:
+                results = self._run_protocol(protocol, feedback, state=state)
+            else:
+                time = self._time_grid(protocol)
+                chunk_size = len(time) if state is None else max(1, -(-len(time) // LIVE_BLOCKS))
+                results = self._collect_blocks(self._iter_blocks(protocol, feedback, time, chunk_size, state),
+                                               len(time), on_chunk)
+            if key is not None:
+                self.cache.put(key, results, {'protocol': protocol, 'feedback': bool(feedback),
+                                              'params': _scalar_params(self.params)})
+            self.results = results
+            self._checkpoint = {'protocol': protocol, 'feedback': feedback, 'state': state}
+            return results
+        finally:
+            self._end_run()
+
+    def continue_to(self, t_end_new):
+        # Extends the last simulate() run to t_end_new. The state carried at its last step lets
+        # only the new steps be computed; runs without one (cache hits, the reference feedback)
+        # are simulated again from t = 0
+        if self._checkpoint is None or not len(self.results.get('time', ())):
+            raise ValueError("continue_to needs a completed simulate() run")
+        protocol = self._checkpoint['protocol']
+        feedback = self._checkpoint['feedback']
+        state = self._checkpoint['state']
+        # The grid the results were computed on, in float64 also for float32 results
+        time = np.asarray(self._time_grid(protocol), dtype=float)
+        if t_end_new <= time[-1]:
+            raise ValueError(f"t_end_new must be beyond the current end time {time[-1]:g}")
         
-        if protocol not in protocol_funcs:
-            raise ValueError(f"Unknown protocol: {protocol}")
+        new_time = self._extension_grid(protocol, time, t_end_new)
+        grid = np.concatenate([time, new_time])
+        grid.setflags(write=False)
+        self.user_params['t_end'] = t_end_new
+        self.user_params['n_points'] = len(grid)
+        self.params = self.params.replace(t_end=t_end_new, n_points=len(grid))
+        self._continued_grids[protocol] = ((t_end_new, len(grid), self.params['time_grid']), grid)
+        if self.params['time_grid'] == 'adaptive':
+            self._adaptive_grids[protocol] = grid
+        if state is None or (feedback and self.params['feedback_mode'] == 'reference'):
+            # Simulated again on the joined grid, which is also what the cache key covers
+            return self.simulate(protocol, feedback)
         
-        results = protocol_funcs[protocol]()
+        self._checkpoint = None
+        try:
+            new_results = self._run_protocol(protocol, feedback, new_time, state)
+        finally:
+            self._end_run()
+        n_old = len(time)
+        results = SimulationResults(n_old + len(new_time), self._batch_shape(), self._result_dtype())
+        for name, values in new_results.items():
+            if name in results.fields:
+                row = results.row(name)
+                row[..., :n_old] = self.results[name]
+                row[..., n_old:] = values
+            elif name in self.results and not name.startswith('_'):
+                results[name] = np.concatenate([self.results[name], values], axis=-1)
+        if self.cache is not None and not self.params['profile']:
+            self.cache.put(self.cache_key(protocol, feedback), results,
+                           {'protocol': protocol, 'feedback': bool(feedback), 'params': _scalar_params(self.params)})
+        self.results = results
+        self._checkpoint = {'protocol': protocol, 'feedback': feedback, 'state': state}
+        return results
+
+    def _extension_grid(self, protocol, time, t_end_new):
+        # Uniform runs keep their step (the last one may be shorter); adaptive runs take the
+        # steps of the adaptive grid for the new end time that lie beyond the old one
+        t_end = time[-1]
+        if self.params['time_grid'] == 'adaptive':
+            self._adaptive_grids.pop(protocol, None)
+            saved = self.params
+            self.params = self.params.replace(t_end=t_end_new)
+            try:
+                grid = self._adaptive_time_grid(protocol)
+            finally:
+                self.params = saved
+            return grid[grid > t_end * (1 + 1e-12)]
+        h = (time[-1] - time[0]) / (len(time) - 1) if len(time) > 1 else t_end_new - t_end
+        steps = max(1, int(np.ceil((t_end_new - t_end) / h - 1e-9)))
+        new_time = t_end + h * np.arange(1, steps + 1)
+        new_time[-1] = t_end_new
+        return new_time
+
+    def simulate_periodic(self, protocol='cyclic', feedback=False, period=None, points_per_cycle=PERIODIC_POINTS,
+                          tol=PERIODIC_TOL, drift_tol=PERIODIC_DRIFT_TOL, max_skip=PERIODIC_MAX_SKIP):
+        # Periodic steady state and slow drift of a periodic protocol up to t_end. Cycles are resolved
+        # one at a time with the incremental integrals. Once consecutive cycles only differ by a steady
+        # drift (small second difference), the carried state (hereditary moments, feedback sums) is
+        # extrapolated linearly over as many cycles as keep the N^2/2 second-difference error within
+        # drift_tol, and the next cycles are resolved to measure the drift again. Returns the cycle
+        # means of every series at the start of each resolved cycle, the sigma_total envelope and
+        # the last cycle in full ('_waveform')
+        period = self._period(protocol) if period is None else period
+        total = max(1, int(np.ceil(self.params['t_end'] / period - 1e-9)))
+        phase = period * np.arange(1, points_per_cycle + 1) / points_per_cycle
         
-        if feedback:
-            results = self._apply_mechanical_feedback(results)
-        results['J_total'] = results.get('J_c', 0) + results.get('J_e', 0) + self.params['Jg0']
-        results['sigma_total'] = results.get('sigma_c', 0) + results.get('sigma_e', 0) + results.get('sigma_g', 0)
+        saved = self.params
+        # Only these carry their history from one cycle to the next
+        self.params = self.params.replace(integration='incremental', feedback_mode='recursive')
+        self._checkpoint = None
+        state = {}
+        waveforms = []
+        cycles = []
+        means = {name: [] for name in RESULT_FIELDS[1:]}
+        envelope = ([], [])
+        try:
+            cycle = 0
+            while cycle < total:
+                time = cycle * period + phase
+                if cycle == 0:
+                    time = np.concatenate([[0.0], time])
+                previous_state = copy.deepcopy(state)
+                waveform = self._run_protocol(protocol, feedback, time, state)
+                
+                sigma_total = np.asarray(waveform['sigma_total'])[..., -points_per_cycle:]
+                cycles.append(cycle)
+                for name in means:
+                    means[name].append(np.mean(np.asarray(waveform[name])[..., -points_per_cycle:], axis=-1))
+                envelope[0].append(np.min(sigma_total, axis=-1))
+                envelope[1].append(np.max(sigma_total, axis=-1))
+                waveforms = (waveforms + [sigma_total])[-3:]
+                cycle += 1
+                self._report_progress('periodic', cycle, total)
+                if len(waveforms) < 3:
+                    continue
+                
+                drift = waveforms[2] - waveforms[1]
+                second = np.max(np.abs(drift - (waveforms[1] - waveforms[0])))
+                scale = np.max(np.abs(waveforms[2]))
+                if second > tol * scale:
+                    continue
+                skip = max_skip if second == 0 else int(np.sqrt(2 * drift_tol * scale / second))
+                # The last cycle is always resolved
+                skip = min(skip, max_skip, total - cycle - 1)
+                if skip < 2:
+                    continue
+                state = self._extrapolate_state(state, previous_state, skip, period)
+                cycle += skip
+                waveforms = []
+            batch_shape = self._batch_shape()
+            dtype = self._result_dtype()
+        finally:
+            self.params = saved
+            self._end_run()
         
+        results = SimulationResults(len(cycles), batch_shape, dtype)
+        results['time'] = period * np.array(cycles, dtype=float)
+        for name, values in means.items():
+            results[name] = np.stack(values, axis=-1)
+        results['sigma_total_min'] = np.stack(envelope[0], axis=-1)
+        results['sigma_total_max'] = np.stack(envelope[1], axis=-1)
+        results['cycle_index'] = np.array(cycles)
+        results['period'] = period
+        results['cycles_total'] = total
+        results['_waveform'] = waveform
         self.results = results
         return results
+
+    def _period(self, protocol):
+        if protocol == 'cyclic':
+            # sin^2 repeats after pi / omega
+            return np.pi / self.params['omega']
+        if protocol not in BUILTIN_PROTOCOLS:
+            period = getattr(get_protocol(protocol).stretch, 'period', None)
+            if period:
+                return period
+        raise ValueError(f"Protocol '{protocol}' has no known period; pass period=")
+
+    def _extrapolate_state(self, state, previous, cycles, period):
+        # Carried values advanced by `cycles` times their change over the last cycle; times
+        # move on by whole periods, which keeps the phase
+        advanced = {}
+        for key, value in state.items():
+            if key == 't_last':
+                advanced[key] = value + cycles * period
+            elif isinstance(value, dict):
+                advanced[key] = self._extrapolate_state(value, previous[key], cycles, period)
+            else:
+                advanced[key] = value + cycles * (value - previous[key])
+        return advanced
+
+    def simulate_iter(self, protocol, feedback=False, chunk_size=STREAM_CHUNK_SIZE):
+        # Yields the results of consecutive blocks of the time grid. Quadrature and closed forms
+        # are local in time; the incremental integrals and the recursive feedback carry their
+        # history between blocks, so only one block of results is held at a time
+        yield from self._iter_blocks(protocol, feedback, self._time_grid(protocol), chunk_size, {})
+
+    def _iter_blocks(self, protocol, feedback, time, chunk_size, state):
+        try:
+            for start in range(0, len(time), chunk_size):
+                yield self._run_protocol(protocol, feedback, time[start:start + chunk_size], state)
+        finally:
+            self._end_run()
+
+    def _collect_blocks(self, blocks, n, on_chunk):
+        # Copies consecutive blocks into one result buffer; rows before `stop` are final
+        results = SimulationResults(n, self._batch_shape(), self._result_dtype())
+        pieces = {}
+        stop = 0
+        for block in blocks:
+            start, stop = stop, stop + len(block['time'])
+            for name, values in block.items():
+                if name in results.fields:
+                    results.row(name)[..., start:stop] = values
+                elif not name.startswith('_'):
+                    pieces.setdefault(name, []).append(values)
+            on_chunk({name: results[name][..., :stop] for name in results})
+        for name, values in pieces.items():
+            results[name] = np.concatenate(values, axis=-1)
+        return results
+
+    def cache_key(self, protocol, feedback=False):
+        # Registered protocols are identified by their stretch history, not only their name
+        name = protocol if protocol in BUILTIN_PROTOCOLS else f"{protocol}:{get_protocol(protocol).key}"
+        return self.cache.key(self.params, name, feedback, self._time_grid(protocol))
+
+    def cancel(self):
+        # Safe to call from another thread; simulate stops at the next step with SimulationCancelled.
+        # A request made before the run reaches simulate is kept until that run starts
+        self._cancel_requested = True
+
+    def reset_cancel(self):
+        # Drops a pending cancel; called by whoever sets up a run, before it starts
+        self._cancel_requested = False
+
+    def _end_run(self):
+        # Every run clears the request when it returns or fails, so a cancel arriving after
+        # its last step does not stop the next one
+        self._cancel_requested = False
+
+    def _report_progress(self, phase, done, total, partial=None):
+        if self._cancel_requested:
+            self._cancel_requested = False
+            raise SimulationCancelled(f"Simulation cancelled during {phase} at step {done} of {total}")
+        if self.progress_callback is None:
+            return
+        if done < total and done % max(1, total // PROGRESS_UPDATES):
+            return
+        self.progress_callback(phase, done / total if total else 1.0,
+                               partial(done) if partial is not None else None)
+
+    def simulate_batch(self, param_grid, protocol, feedback=False):
+        columns = self._param_columns(param_grid)
+        fixed = [name for name in columns if name in BATCH_FIXED_PARAMS]
+        if fixed:
+            raise ValueError(f"Parameters cannot vary within a batch: {', '.join(fixed)}")
+        size = len(next(iter(columns.values()))) if columns else 1
+        time = self._time_grid(protocol)
+        n = len(time)
+        
+        vectorized = (protocol == 'constant' or self._integration_mode(protocol) != 'quad') and \
+                     (not feedback or self.params['feedback_mode'] == 'recursive')
+        
+        if vectorized:
+            # Every member shares the time grid; varied parameters get a leading batch axis
+            batch = copy.copy(self)
+            batch.params = self._validate_and_complete_params({
+                **self.user_params,
+                **{name: np.asarray(values, dtype=float)[:, None] for name, values in columns.items()}
+            })
+            member_results = batch._run_protocol(protocol, feedback, time)
+            results = {name: np.ascontiguousarray(np.broadcast_to(values, (size, n)))
+                       for name, values in member_results.items() if name != 'time' and not name.startswith('_')}
+        else:
+            # Quadrature and the reference feedback sums run member by member into shared buffers
+            results = {}
+            for index in range(size):
+                member = copy.copy(self)
+                member.params = self._validate_and_complete_params({
+                    **self.user_params,
+                    **{name: values[index] for name, values in columns.items()}
+                })
+                for name, values in member._run_protocol(protocol, feedback, time).items():
+                    if name == 'time' or name.startswith('_'):
+                        continue
+                    if name not in results:
+                        results[name] = np.zeros((size, n), dtype=np.asarray(values).dtype)
+                    results[name][index] = values
+        
+        results['time'] = time
+        results['params'] = {name: np.asarray(values) for name, values in columns.items()}
+        return results
+
+    def sensitivity(self, protocol, feedback=False, params=SENSITIVITY_PARAMS):
+        # Forward sensitivities of every series by complex-step differentiation: batch member j
+        # carries params[j] + i*h, so one vectorized run gives d result / d params[j] = Im(result_j) / h
+        # to machine precision. Returns the real series plus 'jacobian'[name] of shape (n, P)
+        names = list(params)
+        fixed = [name for name in names if name in BATCH_FIXED_PARAMS]
+        if fixed:
+            raise ValueError(f"Cannot differentiate with respect to: {', '.join(fixed)}")
+        unknown = [name for name in names if name not in self.params]
+        if unknown:
+            raise ValueError(f"Unknown parameters: {', '.join(unknown)}")
+        
+        overrides = dict(self.user_params)
+        # Quadrature and the reference feedback are not complex-safe; both have batched equivalents
+        if protocol != 'constant' and self._integration_mode(protocol) == 'quad':
+            overrides['integration'] = 'incremental'
+        overrides['feedback_mode'] = 'recursive'
+        for j, name in enumerate(names):
+            column = np.full((len(names), 1), self.params[name], dtype=complex)
+            column[j] += 1j * COMPLEX_STEP
+            overrides[name] = column
+        
+        batch = copy.copy(self)
+        batch.params = self._validate_and_complete_params(overrides)
+        time = self._time_grid(protocol)
+        member_results = batch._run_protocol(protocol, feedback, time)
+        
+        results = {'time': time, 'params': tuple(names), 'jacobian': {}}
+        for name, values in member_results.items():
+            if name not in RESULT_FIELDS or name == 'time':
+                continue
+            values = np.broadcast_to(values, (len(names), len(time)))
+            results[name] = values[0].real.copy()
+            results['jacobian'][name] = np.ascontiguousarray(values.imag.T / COMPLEX_STEP)
+        return results
+
+    def _param_columns(self, param_grid):
+        # A dict of sequences is expanded into all combinations; a list of dicts is used as given
+        if isinstance(param_grid, dict):
+            names = list(param_grid)
+            members = [dict(zip(names, values))
+                       for values in itertools.product(*(np.atleast_1d(param_grid[name]) for name in names))]
+        else:
+            members = list(param_grid)
+        
+        if not members:
+            raise ValueError("Parameter grid is empty")
+        names = list(members[0])
+        for member in members:
+            if set(member) != set(names):
+                raise ValueError("All parameter sets in a batch must override the same parameters")
+        return {name: [member[name] for member in members] for name in names}
+
+    def _run_protocol(self, protocol, feedback, time=None, state=None):
+        # `state` carries the hereditary history between consecutive blocks of one run
+        if protocol not in BUILTIN_PROTOCOLS:
+            get_protocol(protocol)
+        
+        integration = self._integration_mode(protocol)
+        if protocol == 'constant':
+            protocol_func = self._constant_protocol
+        elif protocol == 'linear':
+            protocol_func = {'incremental': lambda: self._linear_protocol_incremental(state),
+                             'analytic': self._linear_protocol_analytic}.get(integration, self._linear_protocol)
+        elif integration == 'incremental':
+            # Registered protocols share the general hereditary formulation of the cyclic one
+            protocol_func = lambda: self._cyclic_protocol_incremental(state, protocol)
+        else:
+            protocol_func = lambda: self._cyclic_protocol(protocol)
+        
+        self._stats = SimulationStats() if self.params['profile'] else None
+        with self._phase('total'):
+            with self._phase('grid'):
+                self.params = self.params.replace(time=self._time_grid(protocol) if time is None else time)
+            self._report_progress(protocol, 0, 1)
+            with self._phase('integration'):
+                series = protocol_func()
+            self._report_progress(protocol, 1, 1)
+            
+            # From here on every series lives in one buffer and is updated in place
+            with self._phase('assembly'):
+                results = SimulationResults(len(self.params['time']), self._batch_shape(),
+                                            self._result_dtype())
+                results.update(series)
+            if feedback:
+                # The feedback iterates on the float64 series, not on their rounded storage
+                with self._phase('feedback'):
+                    results = self._apply_mechanical_feedback(results, series, state)
+            del series
+            with self._phase('assembly'):
+                J_total = results.row('J_total')
+                np.add(results['J_c'], results['J_e'], out=J_total)
+                J_total += self.params['Jg0']
+                sigma_total = results.row('sigma_total')
+                np.add(results['sigma_c'], results['sigma_e'], out=sigma_total)
+                sigma_total += results['sigma_g']
+        
+        if self._stats is not None:
+            results['_stats'] = self._stats.as_dict()
+            self._stats = None
+        return results
+
+    def _integration_mode(self, protocol):
+        # The constant protocol is always evaluated in closed form
+        mode = self.params['integration']
+        if mode not in ('auto', 'analytic', 'quad', 'incremental'):
+            raise ValueError(f"Unknown integration mode: {mode}")
+        closed_form = protocol in ('constant', 'linear')
+        if mode == 'auto':
+            return 'analytic' if closed_form else 'quad'
+        if mode == 'analytic' and not closed_form:
+            raise ValueError(f"The {protocol} protocol has no closed form; use 'quad' or 'incremental'")
+        return mode
+
+    def _batch_shape(self):
+        # simulate_batch passes the varied parameters as (batch, 1) columns
+        columns = [np.shape(value) for value in self.params.values()
+                   if isinstance(value, np.ndarray) and value.ndim == 2]
+        return np.broadcast_shapes(*columns)[:-1] if columns else ()
+
+    def _result_dtype(self):
+        # Complex parameter columns (sensitivity) need complex result buffers, in double
+        # precision whatever the storage: the derivatives are Im(result) / COMPLEX_STEP
+        if self.params['dtype'] not in RESULT_DTYPES:
+            raise ValueError(f"Unknown dtype: {self.params['dtype']}")
+        complex_params = any(isinstance(value, np.ndarray) and np.iscomplexobj(value)
+                             for value in self.params.values())
+        return np.complex128 if complex_params else RESULT_DTYPES[self.params['dtype']]
+
+    def _phase(self, name):
+        return self._stats.timer(name) if self._stats is not None else contextlib.nullcontext()
+
+    def _quad(self, func, a, b, **kwargs):
+        if self._stats is None:
+            return integrate.quad(func, a, b, **kwargs)[0]
+        with self._stats.timer('quad'):
+            result = integrate.quad(func, a, b, full_output=1, **kwargs)
+        self._stats.count('quad_calls')
+        self._stats.count('integrand_evaluations', result[2]['neval'])
+        if len(result) > 3:
+            self._stats.count('quad_warnings')
+        return result[0]
     
+    def _time_grid(self, protocol):
+        mode = self.params['time_grid']
+        # After continue_to the grid is the one actually computed: the old steps plus the new ones
+        continued = self._continued_grids.get(protocol)
+        if continued is not None and continued[0] == (self.params['t_end'], self.params['n_points'], mode):
+            return continued[1]
+        if mode == 'uniform':
+            # Not params['time'], which holds the block of the last run
+            return np.linspace(0, self.params['t_end'], self.params['n_points'])
+        if mode != 'adaptive':
+            raise ValueError(f"Unknown time grid: {mode}")
+        if protocol not in self._adaptive_grids:
+            self._adaptive_grids[protocol] = self._adaptive_time_grid(protocol)
+        return self._adaptive_grids[protocol]
+
+    def _adaptive_time_grid(self, protocol):
+        # A step is accepted when linear interpolation of lambda, sigma_c_roof(lambda) and the
+        # turnover kernel between its ends stays within grid_tol (relative to each signal's
+        # magnitude) at the interior quarter points
+        t_end = float(self.params['t_end'])
+        tol = self.params['grid_tol']
+        k = max(self.params['k_cminus'], self.params['k_eminus'])
+        if t_end <= 0:
+            return np.zeros(1)
+        
+        def signals(tau):
+            lambda_tau = self._stretch(protocol, tau)
+            return np.stack([lambda_tau, self._sigma_c_roof(lambda_tau), np.exp(-k * tau)])
+        
+        scale = np.max(np.abs(signals(np.linspace(0, t_end, 1001))), axis=1)[:, None] + 1e-12
+        fractions = np.array([0.25, 0.5, 0.75])
+        h_max = t_end / MIN_ADAPTIVE_STEPS
+        h_min = t_end * 1e-9
+        h = h_max
+        
+        times = [0.0]
+        f_left = signals(0.0)
+        while times[-1] < t_end:
+            t0 = times[-1]
+            h = min(h, t_end - t0)
+            t1 = t_end if h >= t_end - t0 else t0 + h
+            f_right = signals(t1)
+            f_inner = signals(t0 + fractions * (t1 - t0))
+            linear = f_left[:, None] + fractions * (f_right - f_left)[:, None]
+            error = np.max(np.abs(f_inner - linear) / scale)
+            
+            # Interpolation error grows like h^2
+            factor = 2.0 if error == 0 else min(2.0, max(0.2, 0.9 * np.sqrt(tol / error)))
+            if error <= tol or h <= h_min:
+                times.append(t1)
+                f_left = f_right
+                h = min(h_max, h * max(factor, 1.0))
+            else:
+                h *= factor
+        
+        return np.array(times)
+
+    def _stretch_bounds(self, protocol):
+        if protocol not in BUILTIN_PROTOCOLS:
+            bounds = get_protocol(protocol).stretch_bounds(self.params)
+            if bounds is None:
+                raise ValueError(f"Protocol '{protocol}' needs bounds of its stretch for incremental integration")
+            return bounds
+        lambda_roof = self.params['lambda_roof']
+        if protocol == 'constant':
+            return lambda_roof, lambda_roof
+        if protocol == 'cyclic':
+            return lambda_roof * np.minimum(1, 1 + self.params['a']), lambda_roof * np.maximum(1, 1 + self.params['a'])
+        raise ValueError(f"Stretch of protocol '{protocol}' is unbounded")
+
+    def _stretch(self, protocol, t):
+        # lambda(t) of every protocol, vectorized over t
+        lambda_roof = self.params['lambda_roof']
+        if protocol == 'constant':
+            return lambda_roof * np.ones_like(t, dtype=float)
+        if protocol == 'linear':
+            return lambda_roof * (1 + self.params['a'] * t)
+        if protocol == 'cyclic':
+            return lambda_roof * (1 + self.params['a'] * np.sin(self.params['omega'] * t)**2)
+        return get_protocol(protocol)(t, self.params)
+
+    def _scalar_stretch(self, protocol):
+        # lambda(tau) for the quad integrands, which call it with Python floats
+        if protocol == 'cyclic':
+            lambda_roof, a, omega = self.params['lambda_roof'], self.params['a'], self.params['omega']
+            return lambda tau: lambda_roof * (1 + a * math.sin(omega * tau)**2)
+        stretch = get_protocol(protocol)
+        return lambda tau: float(stretch(tau, self.params))
+
     def _constant_protocol(self):
         t = self.params['time']
         lambda_t = self.params['lambda_roof']
+        J_c = self.params['Jc0'] * self._Q_c(t)
+        J_e = self.params['Je0'] * self._Q_e(t)
         
-        results = {
+        return {
             'time': t,
-            'lambda': np.full_like(t, lambda_t),
-            'sigma_c': np.zeros_like(t),
-            'sigma_e': np.zeros_like(t),
-            'sigma_g': np.zeros_like(t),
-            'J_c': np.zeros_like(t),
-            'J_e': np.zeros_like(t)
+            'lambda': lambda_t * np.ones_like(t),
+            'sigma_c': self._sigma_c_roof(lambda_t) * J_c,
+            'sigma_e': 4 * self.params['c_e'] * lambda_t**2 * (lambda_t**2 - 1) * J_e,
+            'sigma_g': self._calc_sigma_g(t, lambda_t) * np.ones_like(t),
+            'J_c': J_c,
+            'J_e': J_e
         }
-        
-        for i, ti in enumerate(t):
-            Q_c = self._Q_c(ti)
-            Q_e = self._Q_e(ti)
-            results['J_c'][i] = self.params['Jc0'] * Q_c
-            results['J_e'][i] = self.params['Je0'] * Q_e
-            results['sigma_c'][i] = self._sigma_c_roof(lambda_t) * results['J_c'][i]
-            results['sigma_e'][i] = 4 * self.params['c_e'] * lambda_t**2 * (lambda_t**2 - 1) * results['J_e'][i]
-            results['sigma_g'][i] = self._calc_sigma_g(ti, lambda_t)
-        
-        return results
 
     def _linear_protocol(self):
         t = self.params['time']
-        results = {
-            'time': t,
-            'lambda': self.params['lambda_roof'] * (1 + self.params['a'] * t),
-            'sigma_c': np.zeros_like(t),
-            'sigma_e': np.zeros_like(t),
-            'sigma_g': np.zeros_like(t),
-            'J_c': np.zeros_like(t),
-            'J_e': np.zeros_like(t)
-        }
+        lambda_t = self.params['lambda_roof'] * (1 + self.params['a'] * t)
+        J_c = self.params['Jc0'] * self._Q_c(t)
+        J_e = self.params['Je0'] * self._Q_e(t)
+        sigma_c_roof = self._sigma_c_roof(lambda_t)
+        sigma_e_roof = 4 * self.params['c_e'] * lambda_t**2 * (lambda_t**2 - 1)
+        
+        integral_c = np.zeros_like(t)
+        integral_e = np.zeros_like(t)
+        
+        def assemble(stop):
+            return {
+                'time': t[:stop],
+                'lambda': lambda_t[:stop],
+                'sigma_c': (self.params['Jc0']/self.params['J0']) * sigma_c_roof[:stop] * self._q_c(0, t[:stop]) + \
+                           (self.params['j_cplus']/J_c[:stop]) * integral_c[:stop],
+                'sigma_e': (self.params['Je0']/self.params['J0']) * sigma_e_roof[:stop] * self._q_e(0, t[:stop]) + \
+                           (self.params['j_eplus']/J_e[:stop]) * integral_e[:stop],
+                'sigma_g': self._calc_sigma_g(t[:stop], lambda_t[:stop]),
+                'J_c': J_c[:stop],
+                'J_e': J_e[:stop]
+            }
         
         for i, ti in enumerate(t):
-            lambda_t = results['lambda'][i]
+            sigma_c_roof_i = sigma_c_roof[i]
+            sigma_e_roof_i = sigma_e_roof[i]
             def integrand_c(tau):
-                return self._q_c(tau, ti) * self._sigma_c_roof(lambda_t)
+                return self._q_c(tau, ti) * sigma_c_roof_i
             
             def integrand_e(tau):
-                return self._q_e(tau, ti) * 4 * self.params['c_e'] * lambda_t**2 * (lambda_t**2 - 1)
-            
-            integral_c, _ = integrate.quad(integrand_c, 0, ti)
-            integral_e, _ = integrate.quad(integrand_e, 0, ti)
-            Q_c = self._Q_c(ti)
-            Q_e = self._Q_e(ti)
-            results['J_c'][i] = self.params['Jc0'] * Q_c
-            results['J_e'][i] = self.params['Je0'] * Q_e
-            
-            results['sigma_c'][i] = (self.params['Jc0']/self.params['J0']) * self._sigma_c_roof(lambda_t) * self._q_c(0, ti) + \
-                                   (self.params['j_cplus']/results['J_c'][i]) * integral_c
+                return self._q_e(tau, ti) * sigma_e_roof_i
             
-            results['sigma_e'][i] = (self.params['Je0']/self.params['J0']) * 4 * self.params['c_e'] * lambda_t**2 * (lambda_t**2 - 1) * self._q_e(0, ti) + \
-                                   (self.params['j_eplus']/results['J_e'][i]) * integral_e
-            
-            results['sigma_g'][i] = self._calc_sigma_g(ti, lambda_t)
+            integral_c[i] = self._quad(integrand_c, 0, ti)
+            integral_e[i] = self._quad(integrand_e, 0, ti)
+            self._report_progress('linear', i + 1, len(t), assemble)
         
-        return results
+        return assemble(len(t))
 
-    def _cyclic_protocol(self):
+    def _linear_protocol_analytic(self):
+        # The stretch only enters at the current time, so the hereditary integrals reduce to
+        # int_0^t exp(-k(t - tau)) dtau = (1 - exp(-k t)) / k
         t = self.params['time']
-        n = len(t)
-        results = {
+        lambda_t = self.params['lambda_roof'] * (1 + self.params['a'] * t)
+        J_c = self.params['Jc0'] * self._Q_c(t)
+        J_e = self.params['Je0'] * self._Q_e(t)
+        sigma_c_roof = self._sigma_c_roof(lambda_t)
+        sigma_e_roof = 4 * self.params['c_e'] * lambda_t**2 * (lambda_t**2 - 1)
+        
+        return {
             'time': t,
-            'lambda': np.zeros(n),
-            'sigma_c': np.zeros(n),
-            'sigma_e': np.zeros(n),
-            'sigma_g': np.zeros(n),
-            'J_c': np.zeros(n),
-            'J_e': np.zeros(n),
-            'J_total': np.zeros(n)
+            'lambda': lambda_t,
+            'sigma_c': (self.params['Jc0']/self.params['J0']) * sigma_c_roof * self._q_c(0, t) + \
+                       (self.params['j_cplus']/J_c) * sigma_c_roof * self._kernel_integral(self.params['k_cminus'], t),
+            'sigma_e': (self.params['Je0']/self.params['J0']) * sigma_e_roof * self._q_e(0, t) + \
+                       (self.params['j_eplus']/J_e) * sigma_e_roof * self._kernel_integral(self.params['k_eminus'], t),
+            'sigma_g': self._calc_sigma_g(t, lambda_t),
+            'J_c': J_c,
+            'J_e': J_e
         }
+
+    @staticmethod
+    def _kernel_integral(k, t):
+        # int_0^t exp(-k(t - tau)) dtau, with the k = 0 limit t; k may carry batch axes
+        if np.ndim(k) == 0:
+            return -np.expm1(-k * t) / k if k != 0 else np.array(t, dtype=float)
+        k_safe = np.where(k == 0, 1.0, k)
+        return np.where(k == 0, t, -np.expm1(-k_safe * t) / k_safe)
+
+    def _cyclic_protocol(self, protocol='cyclic'):
+        t = self.params['time']
+        lambda0_c = self.params['lambda0_c']
+        lambda0_e = self.params['lambda0_e']
+        c_c = self.params['c_c']
+        c_e = self.params['c_e']
+        alpha_c = self.params['alpha_c']
+        k_cminus = self.params['k_cminus']
+        k_eminus = self.params['k_eminus']
+        stretch_at = self._scalar_stretch(protocol)
         
-        a = self.params['a']
-        lambda_roof = self.params['lambda_roof']
-        omega = np.pi 
+        lambda_t = self._stretch(protocol, t)
+        lambda_start = self._stretch(protocol, 0.0)
+        J_c = self.params['Jc0'] * self._Q_c(t)
+        J_e = self.params['Je0'] * self._Q_e(t)
+        J_total = J_c + J_e + self.params['Jg0']
+        growth_c_t, growth_c = self._growth_table('c', t)
+        growth_e_t, growth_e = self._growth_table('e', t)
         
-        for i, ti in enumerate(t):
+        lambda_c0 = lambda0_c * (lambda_t/lambda_start) * growth_c(0.0) / growth_c_t
+        sigma_c_initial = (self.params['Jc0']/self.params['J0']) * \
+                          self._sigma_c_roof(lambda_c0) * self._q_c(0, t)
+        
+        lambda_e0 = lambda0_e * (lambda_t/lambda_start) * growth_e(0.0) / growth_e_t
+        sigma_e_initial = (self.params['Je0']/self.params['J0']) * \
+                          4 * c_e * lambda_e0**2 * (lambda_e0**2 - 1) * self._q_e(0, t)
+        
+        integral_c = np.zeros_like(t)
+        integral_e = np.zeros_like(t)
+        
+        def assemble(stop):
+            results = {
+                'time': t[:stop],
+                'lambda': lambda_t[:stop],
+                'sigma_c': sigma_c_initial[:stop] + (self.params['j_cplus']/J_total[:stop]) * integral_c[:stop],
+                'sigma_e': sigma_e_initial[:stop] + (self.params['j_eplus']/J_total[:stop]) * integral_e[:stop],
+                'sigma_g': self._calc_sigma_g(t[:stop], lambda_t[:stop]),
+                'J_c': J_c[:stop],
+                'J_e': J_e[:stop],
+                'J_total': J_total[:stop]
+            }
+            results['sigma_total'] = results['sigma_c'] + results['sigma_e'] + results['sigma_g']
+            return results
+        
+        # quad calls the integrands with Python floats, so they are written with math and the
+        # growth factors come from the cached closed form instead of _G_c/_G_e
+        lambda_list = lambda_t.tolist()
+        growth_c_list = growth_c_t.tolist()
+        growth_e_list = growth_e_t.tolist()
+        for i, ti in enumerate(t.tolist()):
             try:
-                results['lambda'][i] = lambda_roof * (1 + a * np.sin(omega * ti)**2)
-                lambda_t = results['lambda'][i]
-                Q_c = self._Q_c(ti)
-                Q_e = self._Q_e(ti)
-                results['J_c'][i] = self.params['Jc0'] * Q_c
-                results['J_e'][i] = self.params['Je0'] * Q_e
-                results['J_total'][i] = results['J_c'][i] + results['J_e'][i] + self.params['Jg0']
+                lambda_i = lambda_list[i]
+                growth_c_i = growth_c_list[i]
+                growth_e_i = growth_e_list[i]
                 def integrand_c(tau):
-                    lambda_tau = lambda_roof * (1 + a * np.sin(omega * tau)**2)
-                    G_ratio = (self._G_c(tau) / self._G_c(ti)) ** (1/(1 + 2*self.params['gamma']))
-                    lambda_cx = self.params['lambda0_c'] * (lambda_t/lambda_tau) * G_ratio
-                    return self._q_c(tau, ti) * self._sigma_c_roof(lambda_cx)
+                    lambda_tau = stretch_at(tau)
+                    lambda_cx = lambda0_c * (lambda_i/lambda_tau) * growth_c(tau) / growth_c_i
+                    stretch_sq = lambda_cx * lambda_cx - 1
+                    return math.exp(-k_cminus * (ti - tau)) * \
+                           4 * c_c * (stretch_sq + 1) * stretch_sq * math.exp(alpha_c * stretch_sq**2)
                 
                 def integrand_e(tau):
-                    lambda_tau = lambda_roof * (1 + a * np.sin(omega * tau)**2)
-                    G_ratio = (self._G_e(tau) / self._G_e(ti)) ** (1/(1 + 2*self.params['gamma']))
-                    lambda_ex = self.params['lambda0_e'] * (lambda_t/lambda_tau) * G_ratio
-                    return self._q_e(tau, ti) * 4 * self.params['c_e'] * lambda_ex**2 * (lambda_ex**2 - 1)
+                    lambda_tau = stretch_at(tau)
+                    lambda_ex = lambda0_e * (lambda_i/lambda_tau) * growth_e(tau) / growth_e_i
+                    return math.exp(-k_eminus * (ti - tau)) * 4 * c_e * lambda_ex**2 * (lambda_ex**2 - 1)
                 
-                integral_c, _ = integrate.quad(integrand_c, 0, ti, limit=100)
-                integral_e, _ = integrate.quad(integrand_e, 0, ti, limit=100)
-
-                lambda_c0 = self.params['lambda0_c'] * (lambda_t/self.params['lambda_roof']) * \
-                        (self._G_c(0)/self._G_c(ti)) ** (1/(1 + 2*self.params['gamma']))
-                
-                sigma_c_initial = (self.params['Jc0']/self.params['J0']) * \
-                                self._sigma_c_roof(lambda_c0) * \
-                                self._q_c(0, ti)
+                integral_c[i] = self._quad(integrand_c, 0, ti, limit=100)
+                integral_e[i] = self._quad(integrand_e, 0, ti, limit=100)
                 
-                sigma_c_integral = (self.params['j_cplus']/results['J_total'][i]) * integral_c
-                results['sigma_c'][i] = sigma_c_initial + sigma_c_integral
+            except Exception as e:
+                print(f"Error in step {i}, t={ti}: {str(e)}")
+                raise
+            self._report_progress(protocol, i + 1, len(t), assemble)
+        
+        return assemble(len(t))
+
+    def _growth_table(self, component, t):
+        # (G(tau)/G(t))^(1/(1+2 gamma)) splits into J(tau)^p / J(t)^p with p = 1/(1+2 gamma)^2.
+        # Returns J^p on the grid and a scalar closed form for arbitrary tau, cached for the
+        # last parameter set and grid of each component (simulate_iter moves through blocks)
+        if component == 'c':
+            J0, k_plus, k_minus = self.params['Jc0'], self.params['k_cplus'], self.params['k_cminus']
+            ratio = self.params['k_ratio_c']
+            unit = k_minus == 0 and k_plus == 0
+            G = self._G_c
+        else:
+            J0, k_plus, k_minus = self.params['Je0'], self.params['k_eplus'], self.params['k_eminus']
+            ratio = self.params['k_ratio_e']
+            unit = k_minus == 0 and k_plus != 0
+            G = self._G_e
+        exponent = self.params['growth_exponent']
+        
+        key = (J0, k_plus, k_minus, exponent, len(t), hash(t.tobytes()))
+        cached = self._growth_tables.get(component)
+        if cached is None or cached[0] != key:
+            if unit:
+                base, amplitude = J0, 0.0
+            elif k_minus != 0:
+                base, amplitude = J0 * ratio, J0 * (1 - ratio)
+            else:
+                base = None
+            power = exponent * exponent
             
-                lambda_e0 = self.params['lambda0_e'] * (lambda_t/self.params['lambda_roof']) * \
-                        (self._G_e(0)/self._G_e(ti)) ** (1/(1 + 2*self.params['gamma']))
-                
-                sigma_e_initial = (self.params['Je0']/self.params['J0']) * \
-                                4 * self.params['c_e'] * lambda_e0**2 * (lambda_e0**2 - 1) * \
-                                self._q_e(0, ti)
+            if base is None:
+                def lookup(tau):
+                    return float(G(tau) ** exponent)
+            else:
+                def lookup(tau):
+                    return (base + amplitude * math.exp(-k_minus * tau)) ** power
+            
+            self._growth_tables[component] = (key, G(t) ** exponent, lookup)
+        return self._growth_tables[component][1:]
+
+    def _linear_protocol_incremental(self, state=None):
+        t = self.params['time']
+        t_ext, skip = self._resume_grid(t, state)
+        lambda_t = self.params['lambda_roof'] * (1 + self.params['a'] * t_ext)
+        J_c = self.params['Jc0'] * self._Q_c(t_ext)
+        J_e = self.params['Je0'] * self._Q_e(t_ext)
+        
+        # The stretch only enters at the current time, so only the kernel is integrated
+        ones = np.ones_like(t_ext)
+        integral_c = self._hereditary_integral(self.params['k_cminus'], t_ext, ones, ones[1:], state, 'c')
+        integral_e = self._hereditary_integral(self.params['k_eminus'], t_ext, ones, ones[1:], state, 'e')
+        
+        sigma_c_roof = self._sigma_c_roof(lambda_t)
+        sigma_e_roof = 4 * self.params['c_e'] * lambda_t**2 * (lambda_t**2 - 1)
+        
+        results = {
+            'time': t_ext,
+            'lambda': lambda_t,
+            'sigma_c': (self.params['Jc0']/self.params['J0']) * sigma_c_roof * self._q_c(0, t_ext) + \
+                       (self.params['j_cplus']/J_c) * sigma_c_roof * integral_c,
+            'sigma_e': (self.params['Je0']/self.params['J0']) * sigma_e_roof * self._q_e(0, t_ext) + \
+                       (self.params['j_eplus']/J_e) * sigma_e_roof * integral_e,
+            'sigma_g': self._calc_sigma_g(t_ext, lambda_t),
+            'J_c': J_c,
+            'J_e': J_e
+        }
+        return {name: values[..., skip:] for name, values in results.items()}
+
+    def _cyclic_protocol_incremental(self, state=None, protocol='cyclic'):
+        t = self.params['time']
+        t_ext, skip = self._resume_grid(t, state)
+        t_mid = 0.5 * (t_ext[1:] + t_ext[:-1])
+        exponent = self.params['growth_exponent']
+        
+        def stretch(tau):
+            return self._stretch(protocol, tau)
+        
+        lambda_t = stretch(t_ext)
+        lambda_start = stretch(0.0)
+        J_c = self.params['Jc0'] * self._Q_c(t_ext)
+        J_e = self.params['Je0'] * self._Q_e(t_ext)
+        J_total = J_c + J_e + self.params['Jg0']
+        
+        # lambda_x(t, tau) = A(t) * B(tau); A collects everything evaluated at t
+        G_c = self._G_c(t_ext)**exponent
+        G_e = self._G_e(t_ext)**exponent
+        A_c = self.params['lambda0_c'] * lambda_t / G_c
+        A_e = self.params['lambda0_e'] * lambda_t / G_e
+        B_c = G_c / lambda_t
+        B_e = G_e / lambda_t
+        B_c_mid = self._G_c(t_mid)**exponent / stretch(t_mid)
+        B_e_mid = self._G_e(t_mid)**exponent / stretch(t_mid)
+        
+        # The interpolation range must not depend on the grid, or blocks continued from
+        # `state` would be expanded on different nodes
+        lambda_low, lambda_high = self._stretch_bounds(protocol)
+        growth_c_low, growth_c_high = self._growth_bounds('c')
+        growth_e_low, growth_e_high = self._growth_bounds('e')
+        
+        def sigma_e_roof(lambda_):
+            return 4 * self.params['c_e'] * lambda_**2 * (lambda_**2 - 1)
+        
+        integral_c = self._separable_hereditary_integral(
+            self.params['k_cminus'], t_ext, A_c, B_c, B_c_mid, self._sigma_c_roof,
+            (growth_c_low / lambda_high, growth_c_high / lambda_low), state, 'c')
+        integral_e = self._separable_hereditary_integral(
+            self.params['k_eminus'], t_ext, A_e, B_e, B_e_mid, sigma_e_roof,
+            (growth_e_low / lambda_high, growth_e_high / lambda_low), state, 'e')
+        
+        sigma_c_initial = (self.params['Jc0']/self.params['J0']) * \
+                          self._sigma_c_roof(A_c * self._G_c(0)**exponent / lambda_start) * self._q_c(0, t_ext)
+        sigma_e_initial = (self.params['Je0']/self.params['J0']) * \
+                          sigma_e_roof(A_e * self._G_e(0)**exponent / lambda_start) * self._q_e(0, t_ext)
+        
+        results = {
+            'time': t_ext,
+            'lambda': lambda_t,
+            'sigma_c': sigma_c_initial + (self.params['j_cplus']/J_total) * integral_c,
+            'sigma_e': sigma_e_initial + (self.params['j_eplus']/J_total) * integral_e,
+            'sigma_g': self._calc_sigma_g(t_ext, lambda_t),
+            'J_c': J_c,
+            'J_e': J_e,
+            'J_total': J_total
+        }
+        results['sigma_total'] = results['sigma_c'] + results['sigma_e'] + results['sigma_g']
+        
+        return {name: values[..., skip:] for name, values in results.items()}
+
+    def _resume_grid(self, t, state):
+        # A block continued from `state` is evaluated with the previous block's last time in
+        # front, so the first increment bridges the two; that point is dropped from the results
+        if state is None:
+            return t, 0
+        t_last = state.get('t_last')
+        state['t_last'] = t[-1]
+        if t_last is None:
+            return t, 0
+        return np.concatenate([[t_last], t]), 1
+
+    def _growth_bounds(self, component):
+        # J(t)^p with p = 1/(1+2 gamma)^2 moves monotonically from J0^p towards its
+        # steady state, so both ends bound it for every t >= 0
+        if component == 'c':
+            J0, k_minus, ratio = self.params['Jc0'], self.params['k_cminus'], self.params['k_ratio_c']
+        else:
+            J0, k_minus, ratio = self.params['Je0'], self.params['k_eminus'], self.params['k_ratio_e']
+        power = self.params['growth_exponent']**2
+        ratio = np.where(np.real(k_minus) > 0, ratio, 1.0)
+        start = np.power(J0, power) * np.ones_like(ratio)
+        limit = np.power(J0 * ratio, power)
+        return np.minimum(start, limit), np.maximum(start, limit)
+
+    def _separable_hereditary_integral(self, k, t, A, B, B_mid, sigma_roof, B_range,
+                                       state=None, key=None):
+        # int_0^t_i q(tau, t_i) * sigma_roof(A(t_i) * B(tau)) dtau. sigma_roof is interpolated in B
+        # on Chebyshev nodes spanning B_range, which splits the integrand into a sum of functions
+        # of tau alone. Leading axes of A, B and B_range are batch axes with their own node sets
+        B_low, B_high = B_range
+        center = 0.5 * (B_high + B_low)
+        half = np.maximum(0.5 * (B_high - B_low), 1e-9 * np.abs(center))
+        
+        theta = np.pi * (np.arange(CHEBYSHEV_NODES) + 0.5) / CHEBYSHEV_NODES
+        nodes = center + half * np.cos(theta)
+        weights = (2.0 / CHEBYSHEV_NODES) * np.cos(np.outer(theta, np.arange(CHEBYSHEV_NODES)))
+        weights[:, 0] *= 0.5
+        
+        def cardinal(B_values):
+            # Clipped on the real part only, so complex-step perturbations pass through
+            x = (B_values - center) / half
+            x = np.where(np.real(x) < -1.0, -1.0, np.where(np.real(x) > 1.0, 1.0, x))
+            T = np.cos(np.arange(CHEBYSHEV_NODES)[:, None] * np.arccos(x)[..., None, :])
+            return weights @ T
+        
+        moments = self._hereditary_integral(np.expand_dims(k, -1), t, cardinal(B), cardinal(B_mid),
+                                            state, key)
+        return np.sum(sigma_roof(nodes[..., :, None] * A[..., None, :]) * moments, axis=-2)
+
+    def _hereditary_integral(self, k, t, f, f_mid, state=None, key=None):
+        # int_0^t_i exp(-k(t_i - tau)) f(tau) dtau for every grid point, carried forward with
+        # I_i = exp(-k dt) I_{i-1} + increment; increments use Simpson's rule on the weighted integrand.
+        # With `state`, the integral starts from the value carried under `key` at t[0]
+        h = np.diff(t)
+        steps = h / 6 * (np.exp(-k*h) * f[..., :-1] + 4 * np.exp(-k*h/2) * f_mid + f[..., 1:])
+        increments = np.zeros(steps.shape[:-1] + t.shape, dtype=steps.dtype)
+        increments[..., 1:] = steps
+        if state is not None and key in state:
+            increments[..., 0] = state[key]
+        integral = self._decayed_cumsum(increments, t, k)
+        if state is not None:
+            state[key] = integral[..., -1]
+        return integral
+
+    @staticmethod
+    def _decayed_cumsum(x, t, k):
+        # y_i = sum_{j<=i} exp(-k(t_i - t_j)) x_j along the last axis. Done in blocks so that
+        # exp(k(t_j - t_start)) stays bounded for long runs; k may carry batch axes
+        n = len(t)
+        s = k * (t - t[0])
+        s_max = np.max(np.abs(k)) * (t - t[0])
+        y = np.empty(np.broadcast(x, s).shape, dtype=np.result_type(x, s))
+        carry = 0.0
+        start = 0
+        while start < n:
+            stop = max(start + 1, np.searchsorted(s_max, s_max[start] + MAX_DECAY_SPAN, side='right'))
+            seg = s[..., start:stop] - s[..., start:start+1]
+            y[..., start:stop] = (np.cumsum(np.exp(seg) * x[..., start:stop], axis=-1) + carry) * np.exp(-seg)
+            if stop < n:
+                carry = y[..., stop-1:stop] * np.exp(-(s[..., stop:stop+1] - s[..., stop-1:stop]))
+            start = stop
+        return y
+
+    def _apply_mechanical_feedback(self, results, series, state=None):
+        # `series` are the protocol series before storage: in float64 whatever the result dtype
+        mode = self.params['feedback_mode']
+        if mode == 'recursive':
+            return self._apply_mechanical_feedback_recursive(results, series, state)
+        if mode == 'reference':
+            if state is not None:
+                raise ValueError("The reference feedback rebuilds the full history and cannot be continued")
+            if self.params['feedback_solver'] != 'picard':
+                raise ValueError("The reference feedback always iterates with 'picard'; "
+                                 f"'{self.params['feedback_solver']}' needs the recursive feedback mode")
+            return self._apply_mechanical_feedback_reference(results, series)
+        raise ValueError(f"Unknown feedback mode: {mode}")
+
+    def _apply_mechanical_feedback_recursive(self, results, series, state=None):
+        # Same scheme as the reference: the sums over j < i only change by one exponentially
+        # decayed term per step, so they are carried along instead of being rebuilt.
+        # With `state`, the loop picks up where the previous block stopped
+        t = self.params['time']
+        n = len(t)
+        K_cplus = self.params['K_cplus']
+        k_cplus = self.params['k_cplus']
+        k_cminus = self.params['k_cminus']
+        epsilon = self.params['epsilon']
+        Jc0 = self.params['Jc0']
+        max_iter = self.params['max_iter']
+        solver = self.params['feedback_solver']
+        if solver not in ('picard', 'anderson', 'newton'):
+            raise ValueError(f"Unknown feedback solver: {solver}")
+        half_k = 0.5 * k_cplus
+        stats = self._stats
+        
+        # In simulate_batch the parameters are (batch, 1) columns; per-step values keep that shape
+        batch_shape = np.broadcast(results['sigma_c'], results['J_c'], results['J_e'],
+                                   results['lambda'], k_cminus).shape[:-1]
+        
+        def steps(values):
+            values = np.broadcast_to(_working(values), batch_shape + (n,))
+            if not batch_shape:
+                return values.tolist()
+            return list(np.moveaxis(values, -1, 0)[..., None])
+        
+        sigma_roof = self._sigma_c_roof(_working(series['lambda']))
+        sigma_roof_steps = steps(sigma_roof)
+        sigma_initial = steps((Jc0/self.params['J0']) * sigma_roof * self._q_c(0, t))
+        J_initial = steps(Jc0 * self._q_c(0, t))
+        sigma_guess = steps(series['sigma_c'])
+        J_guess = steps(series['J_c'])
+        J_other = steps(_working(series['J_e']) + self.params['Jg0'])
+        
+        carried = state.get('feedback') if state is not None else None
+        if carried is None:
+            # The first grid point keeps the unperturbed solution and sets the homeostatic stress
+            # Batch steps are views of the result rows, which are overwritten at the end
+            sigma0_c = sigma_guess[0].copy() if batch_shape else sigma_guess[0]
+            carried = {'t_last': t[0], 'dt_last': 0.0, 'J_last': Jc0, 'sigma_roof_last': sigma_roof_steps[0],
+                       'history_sigma': 0.0, 'history_J': 0.0, 'sigma0_c': sigma0_c}
+            sigma_c_fb = [sigma0_c]
+            J_c_fb = [Jc0]
+            iterations_fb = [0]
+            first = 1
+        else:
+            sigma_c_fb = []
+            J_c_fb = []
+            iterations_fb = []
+            first = 0
+        sigma0_c = carried['sigma0_c']
+        times = t.tolist()
+        decays = steps(np.exp(-k_cminus * (t - np.concatenate([[carried['t_last']], t[:-1]]))))
+        
+        def assemble(values):
+            return np.concatenate([np.broadcast_to(v, batch_shape + (1,)) for v in values], axis=-1)
+        
+        def partial(stop):
+            return {**{name: values[..., :stop] for name, values in results.items()},
+                    'sigma_c': assemble(sigma_c_fb), 'J_c': assemble(J_c_fb)}
+        
+        t_last = carried['t_last']
+        dt_last = carried['dt_last']
+        J_last = carried['J_last']
+        sigma_roof_last = carried['sigma_roof_last']
+        history_sigma = carried['history_sigma']
+        history_J = carried['history_J']
+        for i in range(first, n):
+            dt = times[i] - t_last
+            history_sigma = decays[i] * (history_sigma + dt_last * J_last * sigma_roof_last)
+            history_J = decays[i] * (history_J + dt_last * J_last)
+            
+            converged = False
+            sigma_prev = sigma_guess[i]
+            J_prev = J_guess[i]
+            sigma_roof_i = sigma_roof_steps[i]
+            
+            for iteration in range(max_iter):
+                # One evaluation of the feedback map x -> F(x), x = (sigma_c, J_c)
+                feedback_factor = 1 + K_cplus * (sigma_prev / sigma0_c - 1)
+                sum_sigma = history_sigma + dt * J_prev * sigma_roof_i
+                sum_J = history_J + dt * J_prev
+                J_sum = J_prev + J_other[i]
+                F_sigma = sigma_initial[i] + half_k * feedback_factor * sum_sigma / J_sum
+                F_J = J_initial[i] + half_k * feedback_factor * sum_J
                 
-                sigma_e_integral = (self.params['j_eplus']/results['J_total'][i]) * integral_e
-                results['sigma_e'][i] = sigma_e_initial + sigma_e_integral
+                if solver == 'newton':
+                    # Newton on F(x) - x = 0 with the analytic Jacobian of F
+                    d_factor = half_k * K_cplus / sigma0_c
+                    a11 = d_factor * sum_sigma / J_sum - 1
+                    a12 = half_k * feedback_factor * (dt * sigma_roof_i * J_other[i] - history_sigma) / J_sum**2
+                    a21 = d_factor * sum_J
+                    a22 = half_k * feedback_factor * dt - 1
+                    r_sigma = F_sigma - sigma_prev
+                    r_J = F_J - J_prev
+                    det = a11 * a22 - a12 * a21
+                    sigma_new = sigma_prev - (a22 * r_sigma - a12 * r_J) / det
+                    J_new = J_prev - (a11 * r_J - a21 * r_sigma) / det
+                elif solver == 'anderson' and iteration > 0:
+                    # Anderson mixing with one previous residual, scaled so both components count;
+                    # the coefficient is clipped, which keeps strongly coupled steps from diverging
+                    r_sigma = (F_sigma - sigma_prev) / sigma0_c
+                    r_J = (F_J - J_prev) / Jc0
+                    d_sigma = r_sigma - r_sigma_last
+                    d_J = r_J - r_J_last
+                    mixing = np.clip((d_sigma * r_sigma + d_J * r_J) / (d_sigma * d_sigma + d_J * d_J + 1e-300),
+                                     -1.0, 1.0)
+                    sigma_new = F_sigma - mixing * (F_sigma - F_sigma_last)
+                    J_new = F_J - mixing * (F_J - F_J_last)
+                    r_sigma_last, r_J_last, F_sigma_last, F_J_last = r_sigma, r_J, F_sigma, F_J
+                else:
+                    sigma_new = F_sigma
+                    J_new = F_J
+                    if solver == 'anderson':
+                        r_sigma_last = (F_sigma - sigma_prev) / sigma0_c
+                        r_J_last = (F_J - J_prev) / Jc0
+                        F_sigma_last, F_J_last = F_sigma, F_J
                 
-                results['sigma_g'][i] = self._calc_sigma_g(ti, lambda_t)
+                if np.all((abs(sigma_new - sigma_prev) < epsilon) &
+                          (abs(J_new - J_prev) < epsilon)):
+                    converged = True
+                    break
                 
-            except Exception as e:
-                print(f"Error in step {i}, t={ti}: {str(e)}")
-                raise
+                sigma_prev = sigma_new
+                J_prev = J_new
+            
+            if not converged:
+                print(f"Warning: convergence not reached at t={times[i]}")
+            if stats is not None:
+                stats.iterations.append(iteration + 1)
+                stats.count('feedback_unconverged', not converged)
+            sigma_c_fb.append(sigma_new)
+            J_c_fb.append(J_new)
+            iterations_fb.append(iteration + 1)
+            t_last, dt_last, J_last, sigma_roof_last = times[i], dt, J_new, sigma_roof_steps[i]
+            self._report_progress('feedback', i + 1, n, partial)
         
+        if state is not None:
+            state['feedback'] = {'t_last': t_last, 'dt_last': dt_last, 'J_last': J_last,
+                                 'sigma_roof_last': sigma_roof_last, 'history_sigma': history_sigma,
+                                 'history_J': history_J, 'sigma0_c': sigma0_c}
+        results['sigma_c'] = assemble(sigma_c_fb)
+        results['J_c'] = assemble(J_c_fb)
+        results['feedback_iterations'] = np.array(iterations_fb, dtype=int)
         results['sigma_total'] = results['sigma_c'] + results['sigma_e'] + results['sigma_g']
         
         return results
 
-    def _apply_mechanical_feedback(self, results):
+    def _apply_mechanical_feedback_reference(self, results, series):
         t = self.params['time']
         n = len(t)
-        dt = t[1] - t[0] if n > 1 else 0
-        sigma_c_fb = np.zeros(n)
-        J_c_fb = np.zeros(n)
-        sigma_c_fb[0] = results['sigma_c'][0]
+        
+        def working(name):
+            return np.broadcast_to(_working(series[name]), (n,)).tolist()
+        
+        sigma_guess = working('sigma_c')
+        J_guess = working('J_c')
+        J_e = working('J_e')
+        sigma_c_fb = [0.0] * n
+        J_c_fb = [0.0] * n
+        sigma_c_fb[0] = sigma_guess[0]
         J_c_fb[0] = self.params['Jc0']
         
         K_cplus = self.params['K_cplus']
         sigma0_c = sigma_c_fb[0] 
         k_cplus = self.params['k_cplus']
+        k_cminus = self.params['k_cminus']
+        Jc0 = self.params['Jc0']
+        Jg0 = self.params['Jg0']
+        initial_fraction = Jc0/self.params['J0']
         epsilon = self.params['epsilon']
+        max_iter = self.params['max_iter']
+        stats = self._stats
+        
+        def partial(stop):
+            return {**{name: values[:stop] for name, values in results.items()},
+                    'sigma_c': np.array(sigma_c_fb[:stop]), 'J_c': np.array(J_c_fb[:stop])}
         
+        # lambda(t) of whichever protocol produced the results, evaluated once on the grid
+        sigma_roof = self._sigma_c_roof(_working(series['lambda'])).tolist()
+        times = t.tolist()
+        iterations_fb = np.zeros(n, dtype=int)
         for i in range(1, n):
-            ti = t[i]
-            max_iter = 20
+            ti = times[i]
             converged = False
-            sigma_prev = results['sigma_c'][i]
-            J_prev = results['J_c'][i]
+            sigma_prev = sigma_guess[i]
+            J_prev = J_guess[i]
+            # The kernel q_c(t_j, t_i) does not change between the iterations of one step
+            decays = [math.exp(-k_cminus * (ti - tj)) for tj in times[:i+1]]
+            decay_initial = math.exp(-k_cminus * ti)
             
-            for _ in range(max_iter):
+            for iteration in range(max_iter):
                 sigma_ratio = sigma_prev / sigma0_c
                 feedback_factor = 1 + K_cplus * (sigma_ratio - 1)
                 integral_sigma = 0
                 integral_J = 0
                 
                 for j in range(1, i+1):
-                    tj = t[j]
-                    dtj = t[j] - t[j-1] if j > 0 else 0
+                    dtj = times[j] - times[j-1]
                     J_tj = J_c_fb[j] if j < i else J_prev
-                    sigma_tj = sigma_c_fb[j] if j < i else sigma_prev
-                    J_tj_1 = J_c_fb[j-1]
-                    sigma_tj_1 = sigma_c_fb[j-1]
-                    if self.params['protocol'] == 'constant':
-                        lambda_tau = self.params['lambda_roof']
-                    elif self.params['protocol'] == 'linear':
-                        lambda_tau = self.params['lambda_roof'] * (1 + self.params['a'] * tj)
-                    else:  # cyclic
-                        lambda_tau = self.params['lambda_roof'] * (1 + self.params['a'] * np.sin(np.pi * tj)**2)
-
-                    term_sigma = J_tj * k_cplus * feedback_factor * self._sigma_c_roof(lambda_tau) * self._q_c(tj, ti)
-                    term_J = J_tj * k_cplus * feedback_factor * self._q_c(tj, ti)
+                    term_sigma = J_tj * k_cplus * feedback_factor * sigma_roof[j] * decays[j]
+                    term_J = J_tj * k_cplus * feedback_factor * decays[j]
                 
                     integral_sigma += 0.5 * dtj * term_sigma
                     integral_J += 0.5 * dtj * term_J
                 
-                J_total = J_prev + results['J_e'][i] + self.params['Jg0']
+                J_total = J_prev + J_e[i] + Jg0
                 
-                sigma_new = (self.params['Jc0']/self.params['J0']) * \
-                        self._sigma_c_roof(lambda_tau) * self._q_c(0, ti) + \
+                sigma_new = initial_fraction * sigma_roof[i] * decay_initial + \
                         (1/J_total) * integral_sigma
                 
-                J_new = self.params['Jc0'] * self._q_c(0, ti) + integral_J
+                J_new = Jc0 * decay_initial + integral_J
                 
-                if (np.abs(sigma_new - sigma_prev) < epsilon and 
-                    np.abs(J_new - J_prev) < epsilon):
+                if (abs(sigma_new - sigma_prev) < epsilon and 
+                    abs(J_new - J_prev) < epsilon):
                     converged = True
                     break
                     
@@ -276,12 +1260,18 @@ class ConstrainedMixtureModel:
             
             if not converged:
                 print(f"Warning: convergence not reached at step {i}")
+            if stats is not None:
+                stats.iterations.append(iteration + 1)
+                stats.count('feedback_unconverged', not converged)
             sigma_c_fb[i] = sigma_new
             J_c_fb[i] = J_new
+            iterations_fb[i] = iteration + 1
+            self._report_progress('feedback', i + 1, n, partial)
         
         results['sigma_c'] = sigma_c_fb
         results['J_c'] = J_c_fb
-        results['sigma_total'] = sigma_c_fb + results['sigma_e'] + results['sigma_g']
+        results['feedback_iterations'] = iterations_fb
+        results['sigma_total'] = results['sigma_c'] + results['sigma_e'] + results['sigma_g']
         
         return results
 
@@ -289,18 +1279,18 @@ class ConstrainedMixtureModel:
         return np.exp(-self.params['k_cminus'] * (t - tau))
 
     def _sigma_c_roof(self, lambda_):
-        return (4 * self.params['c_c'] * lambda_**2 * 
-            (lambda_**2 - 1) * 
-            np.exp(self.params['alpha_c'] * (lambda_**2 - 1)**2))
+        c_c, alpha_c = self.params['c_c'], self.params['alpha_c']
+        lambda_sq = lambda_**2
+        return 4 * c_c * lambda_sq * (lambda_sq - 1) * np.exp(alpha_c * (lambda_sq - 1)**2)
     def _G_c(self, t):
-        if t == 0:
-            return self.params['Jc0'] ** (1/(1 + 2*self.params['gamma']))
-        return self._calc_J_c(t) ** (1/(1 + 2*self.params['gamma']))
+        if np.isscalar(t) and t == 0:
+            return self.params['Jc0'] ** self.params['growth_exponent']
+        return self._calc_J_c(t) ** self.params['growth_exponent']
 
     def _G_e(self, t):
-        if t == 0:
-            return self.params['Je0'] ** (1/(1 + 2*self.params['gamma']))
-        return self._calc_J_e(t) ** (1/(1 + 2*self.params['gamma']))
+        if np.isscalar(t) and t == 0:
+            return self.params['Je0'] ** self.params['growth_exponent']
+        return self._calc_J_e(t) ** self.params['growth_exponent']
 
     def _calc_J_c(self, t):
         return self.params['Jc0'] * self._Q_c(t)
@@ -309,21 +1299,31 @@ class ConstrainedMixtureModel:
         return self.params['Je0'] * self._Q_e(t)
 
     def _Q_c(self, t):
-        if self.params['k_cminus'] == 0 and self.params['k_cplus'] == 0:
-            return 1.0
-        return (np.exp(-self.params['k_cminus'] * t)) + \
-            (self.params['k_cplus']/self.params['k_cminus']) * \
-            (1.0 - np.exp(-self.params['k_cminus'] * t))
+        k_plus, k_minus, ratio = self.params['k_cplus'], self.params['k_cminus'], self.params['k_ratio_c']
+        if np.ndim(k_plus) or np.ndim(k_minus):
+            return self._batched_Q(t, ratio, k_minus, (k_minus == 0) & (k_plus == 0))
+        if k_minus == 0 and k_plus == 0:
+            return np.ones_like(t, dtype=float)
+        decay = np.exp(-k_minus * t)
+        return decay + ratio * (1.0 - decay)
 
     def _q_e(self, tau, t):
         return np.exp(-self.params['k_eminus'] * (t - tau))
     
     def _Q_e(self, t):
-        if self.params['k_eminus'] == 0 and self.params['k_eplus'] != 0:
-            return 1.0
-        return (np.exp(-self.params['k_eminus'] * t)) + \
-            (self.params['k_eplus']/self.params['k_eminus']) * \
-            (1.0 - np.exp(-self.params['k_eminus'] * t))
+        k_plus, k_minus = self.params['k_eplus'], self.params['k_eminus']
+        if np.ndim(k_plus) or np.ndim(k_minus):
+            return self._batched_Q(t, self.params['k_ratio_e'], k_minus, (k_minus == 0) & (k_plus != 0))
+        if k_minus == 0 and k_plus != 0:
+            return np.ones_like(t, dtype=float)
+        decay = np.exp(-k_minus * t)
+        return decay + self.params['k_ratio_e'] * (1.0 - decay)
+
+    @staticmethod
+    def _batched_Q(t, ratio, k_minus, unit):
+        # Same closed form with per-member rates; members flagged in `unit` keep Q = 1
+        decay = np.exp(-k_minus * t)
+        return np.where(unit, 1.0, decay + ratio * (1.0 - decay))
             
     def _calc_sigma_g(self, t, lambda_t):
         return (self.params['Jg0']/self.params['J0']) * \
@@ -0,0 +1,103 @@
+import os
+from concurrent.futures import ProcessPoolExecutor
+from multiprocessing import shared_memory
+import numpy as np
+from core.models import ConstrainedMixtureModel
+from core.protocols import install_protocol, protocol_spec
+from core.results import RESULT_FIELDS
+
+
+def _attach(name):
+    # Workers only borrow the block; the parent owns it and unlinks it
+    try:
+        return shared_memory.SharedMemory(name=name, track=False)
+    except TypeError:
+        shm = shared_memory.SharedMemory(name=name)
+        if os.name == 'posix':
+            from multiprocessing import resource_tracker
+            resource_tracker.unregister(shm._name, 'shared_memory')
+        return shm
+
+
+def _fill(out, start, params, protocol, feedback, members, spec=None):
+    # Series go into the shared block; the other entries (feedback iterations, stats) are returned
+    install_protocol(spec)
+    model = ConstrainedMixtureModel(params)
+    if members is None:
+        results = model.simulate(protocol, feedback)
+        rows = slice(start, start + 1)
+    else:
+        results = model.simulate_batch(members, protocol, feedback)
+        rows = slice(start, start + len(members))
+    for field, name in enumerate(RESULT_FIELDS):
+        values = np.asarray(results[name])
+        out[rows, field, :values.shape[-1]] = values
+    return {name: values for name, values in results.items() if name not in RESULT_FIELDS}
+
+
+def _run_task(shm_name, shape, dtype, *task):
+    shm = _attach(shm_name)
+    try:
+        out = np.ndarray(shape, dtype=dtype, buffer=shm.buf)
+        extras = _fill(out, *task)
+        del out
+        return extras
+    finally:
+        shm.close()
+
+
+class ParallelRunner:
+    def __init__(self, jobs=None):
+        if jobs is not None and jobs < 0:
+            raise ValueError(f"jobs must be 0 or None (all cores) or a positive number of processes, not {jobs}")
+        self.jobs = jobs or os.cpu_count() or 1
+
+    def run_protocols(self, params, feedback=False, protocols=('constant', 'linear', 'cyclic')):
+        # Adaptive grids differ between protocols; rows are padded to the longest one
+        model = ConstrainedMixtureModel(params)
+        lengths = [len(model._time_grid(protocol)) for protocol in protocols]
+        tasks = [(i, params, protocol, feedback, None, protocol_spec(protocol))
+                 for i, protocol in enumerate(protocols)]
+        block, extras = self._execute(len(protocols), max(lengths), tasks, model._result_dtype())
+        return {protocol: {**dict(zip(RESULT_FIELDS, block[i, :, :lengths[i]])), **extras[i]}
+                for i, protocol in enumerate(protocols)}
+
+    def run_sweep(self, params, param_grid, protocol, feedback=False):
+        model = ConstrainedMixtureModel(params)
+        columns = model._param_columns(param_grid)
+        size = len(next(iter(columns.values()))) if columns else 1
+        members = [{name: values[i] for name, values in columns.items()} for i in range(size)]
+
+        # Several chunks per worker so that slow members (quadrature, feedback) even out
+        n_chunks = min(size, self.jobs * 4)
+        bounds = np.linspace(0, size, n_chunks + 1).astype(int)
+        spec = protocol_spec(protocol)
+        tasks = [(start, params, protocol, feedback, members[start:stop], spec)
+                 for start, stop in zip(bounds[:-1], bounds[1:]) if stop > start]
+        time = model._time_grid(protocol)
+        block, _ = self._execute(size, len(time), tasks, model._result_dtype())
+
+        results = {name: block[:, field] for field, name in enumerate(RESULT_FIELDS)}
+        results['time'] = time
+        results['params'] = {name: np.asarray(values) for name, values in columns.items()}
+        return results
+
+    def _execute(self, rows, n, tasks, dtype=np.float64):
+        # Shared in the result storage dtype of the runs, so float32 sweeps move half the bytes.
+        # Returns the block and what each task returned besides its series
+        shape = (rows, len(RESULT_FIELDS), n)
+        shm = shared_memory.SharedMemory(create=True, size=max(1, int(np.prod(shape)) * np.dtype(dtype).itemsize))
+        try:
+            if self.jobs <= 1 or len(tasks) <= 1:
+                out = np.ndarray(shape, dtype=dtype, buffer=shm.buf)
+                extras = [_fill(out, *task) for task in tasks]
+                del out
+            else:
+                with ProcessPoolExecutor(max_workers=min(self.jobs, len(tasks))) as pool:
+                    futures = [pool.submit(_run_task, shm.name, shape, dtype, *task) for task in tasks]
+                    extras = [future.result() for future in futures]
+            block = np.ndarray(shape, dtype=dtype, buffer=shm.buf).copy()
+        finally:
+            shm.close()
+            shm.unlink()
+        return block, extras
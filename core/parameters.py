@@ -0,0 +1,116 @@
+import hashlib
+from collections.abc import Mapping
+import numpy as np
+from core.cache import _encode
+from core.constans import DEFAULT_PARAMS
+
+# Entries computed from the others. Overrides of these are ignored, except through replace()
+DERIVED_PARAMS = ('time', 'J0', 'Jc0', 'Je0', 'Jg0', 'growth_exponent', 'k_ratio_c', 'k_ratio_e')
+
+
+def _ratio(k_plus, k_minus):
+    # k+/k-, NaN where k- = 0; k may carry batch axes
+    if np.ndim(k_plus) == 0 and np.ndim(k_minus) == 0:
+        return k_plus / k_minus if k_minus != 0 else np.nan
+    k_safe = np.where(k_minus == 0, 1.0, k_minus)
+    return np.where(k_minus == 0, np.nan, k_plus / k_safe)
+
+
+class Parameters(Mapping):
+    # Completed, read-only model parameters: DEFAULT_PARAMS updated with the overrides plus the
+    # derived constants, all computed once. Equal parameter sets hash equal, so one object can be
+    # shared by batch members and worker processes and used as a key. replace() makes a new one
+    __slots__ = ('_inputs', '_values', '_digest')
+
+    def __init__(self, overrides=None):
+        if isinstance(overrides, Parameters):
+            overrides = overrides._inputs
+        inputs = {name: value for name, value in {**DEFAULT_PARAMS, **(overrides or {})}.items()
+                  if name not in DERIVED_PARAMS}
+        if np.ndim(inputs['k_cminus']) == 0 and np.ndim(inputs['k_cplus']) == 0 and \
+                inputs['k_cminus'] == 0 and inputs['k_cplus'] != 0:
+            raise ValueError("k_cminus cannot be 0 when k_cplus != 0")
+        self._inputs = inputs
+        self._values = self._complete(inputs)
+        self._digest = None
+
+    @staticmethod
+    def _complete(inputs):
+        values = dict(inputs)
+        time = np.linspace(0, values['t_end'], values['n_points'])
+        time.setflags(write=False)
+        values['time'] = time
+        values['J0'] = 1.0
+        values['Jc0'] = values['fi0_c']
+        values['Je0'] = values['fi0_e']
+        values['Jg0'] = values['fi0_g']
+
+        if values.get('j_cplus') is None:
+            values['j_cplus'] = values['k_cplus'] * values['Jc0']
+        if values.get('j_eplus') is None:
+            values['j_eplus'] = values['k_eplus'] * values['Je0']
+
+        # Homeostatic tension
+        if values['sigma0_c'] is None:
+            lambda_c0 = values['lambda0_c']
+            sigma_c_roof = (4 * values['c_c'] * lambda_c0**2 * (lambda_c0**2 - 1) *
+                            np.exp(values['alpha_c'] * (lambda_c0**2 - 1)**2))
+            values['sigma0_c'] = (values['Jc0']/values['J0']) * sigma_c_roof
+
+        # Constants of the growth factors and the turnover closed forms
+        values['growth_exponent'] = 1/(1 + 2*values['gamma'])
+        values['k_ratio_c'] = _ratio(values['k_cplus'], values['k_cminus'])
+        values['k_ratio_e'] = _ratio(values['k_eplus'], values['k_eminus'])
+        return values
+
+    def replace(self, **changes):
+        # Derived entries given here are taken as they are (the time block of one run);
+        # any other change completes the parameters again
+        inputs = {name: value for name, value in changes.items() if name not in DERIVED_PARAMS}
+        new = Parameters({**self._inputs, **inputs}) if inputs else self._copy()
+        for name, value in changes.items():
+            if name in DERIVED_PARAMS:
+                new._values[name] = value
+        return new
+
+    def _copy(self):
+        new = object.__new__(Parameters)
+        new._inputs = self._inputs
+        new._values = dict(self._values)
+        new._digest = None
+        return new
+
+    def digest(self):
+        if self._digest is None:
+            digest = hashlib.sha256()
+            for name in sorted(self._values):
+                digest.update(name.encode() + b'=' + _encode(self._values[name]) + b';')
+            self._digest = digest.hexdigest()
+        return self._digest
+
+    def __getitem__(self, name):
+        return self._values[name]
+
+    def __iter__(self):
+        return iter(self._values)
+
+    def __len__(self):
+        return len(self._values)
+
+    def __hash__(self):
+        return hash(self.digest())
+
+    def __eq__(self, other):
+        if isinstance(other, Parameters):
+            return self.digest() == other.digest()
+        return NotImplemented
+
+    def __getstate__(self):
+        return self._inputs, self._values
+
+    def __setstate__(self, state):
+        self._inputs, self._values = state
+        self._digest = None
+
+    def __repr__(self):
+        return f"Parameters({len(self._values)} entries, {self.digest()[:12]})"
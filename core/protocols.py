@@ -0,0 +1,124 @@
+import hashlib
+import numpy as np
+
+# Protocols with their own closed forms in ConstrainedMixtureModel; every other protocol, the
+# cyclic one included, goes through the general hereditary formulation
+BUILTIN_PROTOCOLS = ('constant', 'linear', 'cyclic')
+
+
+class StretchProtocol:
+    # A loading protocol defined by its stretch history. `stretch(t, params)` is vectorized over
+    # an array of times. `bounds` is (lambda_min, lambda_max) over all t >= 0, or a function of
+    # the parameters returning it, which the incremental integration needs for its
+    # interpolation nodes; None if unknown
+    def __init__(self, name, stretch, bounds=None, key=None):
+        self.name = name
+        self.stretch = stretch
+        self.bounds = bounds
+        # Identifies the stretch history in result cache keys
+        self.key = key or _code_key(stretch)
+
+    def __call__(self, t, params):
+        return self.stretch(t, params)
+
+    def stretch_bounds(self, params):
+        return self.bounds(params) if callable(self.bounds) else self.bounds
+
+
+class StretchTable:
+    # Linear interpolation of a sampled stretch history; a class rather than a closure so that
+    # table protocols can be sent to worker processes
+    def __init__(self, time, stretch, period=None):
+        self.time = time
+        self.stretch = stretch
+        self.period = period
+
+    def __call__(self, t, params):
+        return np.interp(t, self.time, self.stretch, period=self.period)
+
+
+def _code_key(func):
+    # The bytecode alone does not identify a closure: the captured values, the defaults and the
+    # module globals it reads (e.g. an amplitude) are part of the stretch history
+    code = getattr(func, '__code__', None)
+    if code is None:
+        return f"{type(func).__module__}.{type(func).__qualname__}"
+    digest = hashlib.sha256(code.co_code + repr(code.co_consts).encode())
+    for cell in func.__closure__ or ():
+        try:
+            digest.update(b'cell=' + _value_bytes(cell.cell_contents))
+        except ValueError:
+            digest.update(b'cell=<empty>')
+    digest.update(b'defaults=' + _value_bytes(func.__defaults__))
+    digest.update(b'kwdefaults=' + _value_bytes(func.__kwdefaults__))
+    for name in code.co_names:
+        value = func.__globals__.get(name)
+        if value is not None and not callable(value) and not isinstance(value, type(np)):
+            digest.update(name.encode() + b'=' + _value_bytes(value))
+    return f"{func.__module__}.{func.__qualname__}:{digest.hexdigest()[:16]}"
+
+
+def _value_bytes(value):
+    if isinstance(value, np.ndarray):
+        return f"{value.dtype.str}{value.shape}".encode() + np.ascontiguousarray(value).tobytes()
+    if isinstance(value, (tuple, list)):
+        return b'(' + b','.join(_value_bytes(item) for item in value) + b')'
+    if callable(value) and hasattr(value, '__code__'):
+        # Helpers by their code only, which also keeps self-referencing closures finite
+        return f"{value.__qualname__}:".encode() + value.__code__.co_code
+    return repr(value).encode()
+
+
+PROTOCOLS = {}
+
+
+def register_protocol(name, stretch, bounds=None, key=None):
+    # `stretch(t, params)` -> lambda at the times t; `bounds` is a (low, high) pair or a
+    # function of the parameters returning one
+    if name in BUILTIN_PROTOCOLS or name == 'all':
+        raise ValueError(f"'{name}' is a built-in protocol")
+    PROTOCOLS[name] = StretchProtocol(name, stretch, bounds, key)
+    return PROTOCOLS[name]
+
+
+def register_table(name, time, stretch, period=None):
+    # Stretch history sampled at increasing times, e.g. a measured bioreactor waveform. It is
+    # interpolated linearly, held at its last value, or repeated with `period`
+    time = np.array(time, dtype=float)
+    stretch = np.array(stretch, dtype=float)
+    if time.ndim != 1 or time.shape != stretch.shape or len(time) < 2:
+        raise ValueError("time and stretch must be 1-D arrays of the same length")
+    if np.any(np.diff(time) <= 0):
+        raise ValueError("Table times must be increasing")
+    time.setflags(write=False)
+    stretch.setflags(write=False)
+    digest = hashlib.sha256(time.tobytes() + stretch.tobytes() + repr(period).encode()).hexdigest()[:16]
+    return register_protocol(name, StretchTable(time, stretch, period),
+                             (float(stretch.min()), float(stretch.max())), f"table:{digest}")
+
+
+def load_table(name, path, period=None):
+    # CSV with 'time' and 'stretch' columns or two bare columns time, stretch
+    table = np.genfromtxt(path, delimiter=',', names=True)
+    names = table.dtype.names or ()
+    if 'time' in names and 'stretch' in names:
+        return register_table(name, table['time'], table['stretch'], period)
+    table = np.loadtxt(path, delimiter=',', ndmin=2)
+    return register_table(name, table[:, 0], table[:, 1], period)
+
+
+def get_protocol(name):
+    if name not in PROTOCOLS:
+        raise ValueError(f"Unknown protocol: {name}")
+    return PROTOCOLS[name]
+
+
+def protocol_spec(name):
+    # What a worker process needs to know about `name`: None for built-in protocols
+    return None if name in BUILTIN_PROTOCOLS else get_protocol(name)
+
+
+def install_protocol(spec):
+    # Makes a protocol from protocol_spec known in this process (spawned workers start empty)
+    if spec is not None:
+        PROTOCOLS[spec.name] = spec
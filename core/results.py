@@ -0,0 +1,77 @@
+from collections.abc import MutableMapping
+import numpy as np
+
+# Time series produced by every protocol, in buffer row order
+RESULT_FIELDS = ('time', 'lambda', 'sigma_c', 'sigma_e', 'sigma_g', 'J_c', 'J_e', 'J_total', 'sigma_total')
+
+
+class SimulationResults(MutableMapping):
+    # The series of one run as the rows of a single contiguous (fields, *batch, n) buffer.
+    # results[name] is a view of its row and assigning to it writes into the row, so the usual
+    # dict-style code works unchanged. Entries that are not series (iteration counts, stats)
+    # are kept in `extras`
+    def __init__(self, n, batch_shape=(), dtype=np.float64, fields=RESULT_FIELDS):
+        self.fields = tuple(fields)
+        self.buffer = np.empty((len(self.fields),) + tuple(batch_shape) + (n,), dtype=dtype)
+        self.extras = {}
+        self._rows = {name: i for i, name in enumerate(self.fields)}
+        self._filled = set()
+
+    @classmethod
+    def from_dict(cls, results, dtype=np.float64):
+        time = np.asarray(results['time'])
+        batch = [np.shape(results[name])[:-1] for name in RESULT_FIELDS if name in results]
+        out = cls(time.shape[-1], np.broadcast_shapes(*batch), dtype)
+        out.update(results)
+        return out
+
+    def row(self, name):
+        # Writable view of a series, marked as present; the caller fills it
+        self._filled.add(name)
+        return self.buffer[self._rows[name]]
+
+    def __getitem__(self, name):
+        if name in self._rows:
+            if name not in self._filled:
+                raise KeyError(name)
+            return self.buffer[self._rows[name]]
+        return self.extras[name]
+
+    def __setitem__(self, name, values):
+        if name in self._rows:
+            self.buffer[self._rows[name]] = values
+            self._filled.add(name)
+        else:
+            self.extras[name] = values
+
+    def __delitem__(self, name):
+        if name in self._rows:
+            if name not in self._filled:
+                raise KeyError(name)
+            self._filled.discard(name)
+        else:
+            del self.extras[name]
+
+    def __iter__(self):
+        for name in self.fields:
+            if name in self._filled:
+                yield name
+        yield from list(self.extras)
+
+    def __len__(self):
+        return len(self._filled) + len(self.extras)
+
+    def __repr__(self):
+        return f"SimulationResults({', '.join(self)}; buffer {self.buffer.shape} {self.buffer.dtype})"
+
+    def to_npz(self, path):
+        # Rows are passed as views; np.savez streams each one into the archive
+        np.savez(path, **{name: values for name, values in self.items() if not name.startswith('_')})
+
+    def to_csv(self, path, fmt='%.10g'):
+        if self.buffer.ndim != 2:
+            raise ValueError("CSV export needs a single run without batch axis")
+        names = [name for name in self.fields if name in self._filled]
+        # The transposed buffer is a view, so the rows are written without assembling a table
+        table = self.buffer.T if len(names) == len(self.fields) else self.buffer[[self._rows[n] for n in names]].T
+        np.savetxt(path, table, fmt=fmt, delimiter=',', header=','.join(names), comments='')
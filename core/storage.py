@@ -0,0 +1,251 @@
+import json
+import os
+import struct
+from collections.abc import Mapping
+import numpy as np
+from core.results import RESULT_FIELDS
+
+MANIFEST = 'manifest.json'
+# Columnar result files (.cmm): magic, header length as <u8, JSON header, then the columns.
+# The header and every column start on a COLUMNAR_ALIGN byte boundary
+COLUMNAR_MAGIC = b'CMMCOL1\n'
+COLUMNAR_ALIGN = 64
+COLUMNAR_VERSION = 1
+
+
+def _json_value(value):
+    # Scalars only; arrays such as the time grid are already in the blocks
+    if isinstance(value, np.generic):
+        value = value.item()
+    if isinstance(value, (bool, int, float, str)):
+        return value
+    return None
+
+
+def _replace(path, write):
+    # Readers only ever see complete files: everything is written beside the target and renamed
+    tmp = path + '.tmp'
+    with open(tmp, 'wb') as f:
+        write(f)
+    os.replace(tmp, path)
+
+
+class ChunkedResultWriter:
+    # Writes each block from simulate_iter to <path>/chunk_NNNNNN.npy as a (fields, steps) array.
+    # manifest.json lists the finished blocks, so a run can be read while it is still going
+    def __init__(self, path, protocol, feedback=False, params=None, fields=RESULT_FIELDS):
+        self.path = path
+        os.makedirs(path, exist_ok=True)
+        self.manifest = {
+            'protocol': protocol,
+            'feedback': bool(feedback),
+            'fields': list(fields),
+            'params': {name: _json_value(value) for name, value in (params or {}).items()
+                       if _json_value(value) is not None},
+            'chunks': [],
+            'steps': 0,
+            'complete': False
+        }
+        self._write_manifest()
+
+    def write(self, chunk):
+        time = np.asarray(chunk['time'], dtype=float)
+        block = np.stack([np.broadcast_to(np.asarray(chunk[name], dtype=float), time.shape)
+                          for name in self.manifest['fields']])
+        name = f"chunk_{len(self.manifest['chunks']):06d}.npy"
+        _replace(os.path.join(self.path, name), lambda f: np.save(f, block))
+        self.manifest['chunks'].append({'file': name, 'start': self.manifest['steps'], 'steps': len(time),
+                                        't_first': float(time[0]), 't_last': float(time[-1])})
+        self.manifest['steps'] += len(time)
+        self._write_manifest()
+
+    def close(self):
+        self.manifest['complete'] = True
+        self._write_manifest()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, exc_type, exc, tb):
+        # An interrupted run keeps complete=False but its finished blocks stay readable
+        if exc_type is None:
+            self.close()
+        return False
+
+    def _write_manifest(self):
+        text = json.dumps(self.manifest, indent=2).encode()
+        _replace(os.path.join(self.path, MANIFEST), lambda f: f.write(text))
+
+
+def read_manifest(path):
+    with open(os.path.join(path, MANIFEST)) as f:
+        return json.load(f)
+
+
+def iter_chunks(path, start=0):
+    # Blocks from index `start` on, as result dicts; call again with the next index to follow a live run
+    manifest = read_manifest(path)
+    for entry in manifest['chunks'][start:]:
+        block = np.load(os.path.join(path, entry['file']))
+        yield dict(zip(manifest['fields'], block))
+
+
+def read_chunked_results(path, fields=None):
+    manifest = read_manifest(path)
+    fields = list(fields or manifest['fields'])
+    rows = [manifest['fields'].index(name) for name in fields]
+    results = {name: np.empty(manifest['steps']) for name in fields}
+    for entry in manifest['chunks']:
+        block = np.load(os.path.join(path, entry['file']), mmap_mode='r')
+        for name, row in zip(fields, rows):
+            results[name][entry['start']:entry['start'] + entry['steps']] = block[row]
+    return results
+
+
+def write_batch(path, runs, fields=RESULT_FIELDS):
+    # One file for a whole batch of runs ({'protocol', 'feedback', 'params', <fields>}): each field
+    # is a (runs, steps) column padded with NaN past the end of shorter runs and 'steps' holds the
+    # lengths. A .cmm path gives a columnar file with the runs' protocol, feedback and parameters
+    # in its header; otherwise an .npz where every parameter named in any run is a column
+    # 'param.<name>' (NaN where missing)
+    steps = np.array([len(run['time']) for run in runs], dtype=int)
+    dtype = np.result_type(*(np.asarray(run[name]).dtype for run in runs for name in fields))
+    series = {}
+    for name in fields:
+        column = np.full((len(runs), steps.max(initial=0)), np.nan, dtype=dtype)
+        for i, run in enumerate(runs):
+            column[i, :steps[i]] = run[name]
+        series[name] = column
+    if path.endswith('.cmm'):
+        write_columnar(path, {**series, 'steps': steps}, dtype=np.dtype(dtype).name, fields=list(fields),
+                       runs=[{'protocol': run['protocol'], 'feedback': bool(run['feedback']),
+                              'params': _json_params(run['params'])} for run in runs])
+        return
+    
+    columns = {'steps': steps,
+               'protocol': np.array([run['protocol'] for run in runs]),
+               'feedback': np.array([bool(run['feedback']) for run in runs]),
+               **series}
+    names = sorted({name for run in runs for name in run['params']})
+    for name in names:
+        values = [_json_value(run['params'].get(name)) for run in runs]
+        if all(isinstance(value, str) for value in values if value is not None):
+            columns[f"param.{name}"] = np.array(['' if value is None else value for value in values])
+        else:
+            columns[f"param.{name}"] = np.array([np.nan if value is None else float(value) for value in values])
+    _replace(path, lambda f: np.savez(f, **columns))
+
+
+def read_batch(path):
+    # Columns of write_batch, with the parameters gathered into 'params'
+    with np.load(path) as data:
+        columns = {name: data[name] for name in data.files}
+    columns['params'] = {name[len('param.'):]: columns.pop(name) for name in list(columns)
+                         if name.startswith('param.')}
+    return columns
+
+
+def _json_params(params):
+    return {name: _json_value(value) for name, value in (params or {}).items() if _json_value(value) is not None}
+
+
+def _aligned(size):
+    return -(-size // COLUMNAR_ALIGN) * COLUMNAR_ALIGN
+
+
+def write_columnar(path, columns, **header):
+    # Each column is stored C-ordered in one contiguous block; the JSON header lists name, dtype,
+    # shape and offset (from the end of the header) of every column, plus the given entries
+    arrays = {name: np.ascontiguousarray(values) for name, values in columns.items()}
+    entries = {}
+    offset = 0
+    for name, values in arrays.items():
+        entries[name] = {'dtype': values.dtype.str, 'shape': list(values.shape), 'offset': offset}
+        offset += _aligned(values.nbytes)
+    text = json.dumps({'version': COLUMNAR_VERSION, **header, 'columns': entries}).encode()
+    prefix = len(COLUMNAR_MAGIC) + 8
+    text += b' ' * (_aligned(prefix + len(text)) - prefix - len(text))
+    
+    def write(f):
+        f.write(COLUMNAR_MAGIC)
+        f.write(struct.pack('<Q', len(text)))
+        f.write(text)
+        for values in arrays.values():
+            # Written from the array's memory, without a bytes copy of the column
+            f.write(values.reshape(-1).view(np.uint8).data)
+            f.write(b'\0' * (_aligned(values.nbytes) - values.nbytes))
+    _replace(path, write)
+
+
+def write_results(path, results, protocol=None, feedback=False, params=None):
+    # A run in columnar form: the series and other arrays along the time axis become columns,
+    # scalar extras go into the header
+    names = [name for name in RESULT_FIELDS if name in results]
+    n = np.shape(results['time'])[-1]
+    columns = {name: np.asarray(results[name]) for name in names}
+    extras = {}
+    for name, value in results.items():
+        if name in columns or name.startswith('_'):
+            continue
+        if isinstance(value, np.ndarray) and value.ndim and value.shape[-1] == n:
+            columns[name] = value
+        elif _json_value(value) is not None:
+            extras[name] = _json_value(value)
+    dtype = np.result_type(*(columns[name] for name in names))
+    write_columnar(path, columns, protocol=protocol, feedback=bool(feedback), dtype=np.dtype(dtype).name,
+                   fields=names, params=_json_params(params), extras=extras)
+
+
+def read_columnar_header(path):
+    # The header alone, and the file offset of the first column
+    with open(path, 'rb') as f:
+        if f.read(len(COLUMNAR_MAGIC)) != COLUMNAR_MAGIC:
+            raise ValueError(f"{path} is not a columnar result file")
+        length, = struct.unpack('<Q', f.read(8))
+        header = json.loads(f.read(length))
+    if header.get('version', 0) > COLUMNAR_VERSION:
+        raise ValueError(f"{path} has format version {header['version']}, newer than {COLUMNAR_VERSION}")
+    return header, len(COLUMNAR_MAGIC) + 8 + length
+
+
+class ColumnarResults(Mapping):
+    # Read-only results of a .cmm file. Columns are memory-mapped when first accessed, so reading
+    # sigma_total of a large sweep touches only that column's pages. results.header holds
+    # protocol, feedback, dtype, params and, for batches, 'runs'
+    def __init__(self, path):
+        self.path = path
+        self.header, self._data_offset = read_columnar_header(path)
+        self._columns = {}
+
+    def __getitem__(self, name):
+        if name not in self._columns:
+            entry = self.header['columns'][name]
+            shape = tuple(entry['shape'])
+            if not np.prod(shape, dtype=int):
+                # mmap has no zero-length mappings
+                self._columns[name] = np.empty(shape, dtype=entry['dtype'])
+            else:
+                self._columns[name] = np.memmap(self.path, dtype=entry['dtype'], mode='r',
+                                                offset=self._data_offset + entry['offset'], shape=shape)
+        return self._columns[name]
+
+    def __iter__(self):
+        return iter(self.header['columns'])
+
+    def __len__(self):
+        return len(self.header['columns'])
+
+    @property
+    def protocol(self):
+        return self.header.get('protocol')
+
+    @property
+    def feedback(self):
+        return self.header.get('feedback')
+
+    @property
+    def params(self):
+        return self.header.get('params', {})
+
+    def __repr__(self):
+        return f"ColumnarResults({self.path!r}, {', '.join(self)})"
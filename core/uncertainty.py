@@ -0,0 +1,192 @@
+import os
+from collections import deque
+from concurrent.futures import ProcessPoolExecutor
+import numpy as np
+from scipy.special import ndtri
+from scipy.stats import qmc
+from core.models import ConstrainedMixtureModel
+from core.protocols import install_protocol, protocol_spec
+
+# Percentiles of the bands returned by propagate
+DEFAULT_PERCENTILES = (2.5, 25.0, 50.0, 75.0, 97.5)
+# Samples per simulate_batch call (one batch axis of this length per worker)
+UQ_CHUNK_SIZE = 256
+# Chunks submitted per worker ahead of the one being reduced
+CHUNKS_IN_FLIGHT = 2
+
+
+def unit_samples(count, dimensions, method='lhs', seed=None):
+    # Points in the open unit cube: Latin hypercube, scrambled Sobol or plain random
+    if method == 'lhs':
+        return qmc.LatinHypercube(d=dimensions, seed=seed).random(count)
+    if method == 'sobol':
+        return qmc.Sobol(d=dimensions, scramble=True, seed=seed).random(count)
+    if method == 'random':
+        return np.random.default_rng(seed).random((count, dimensions))
+    raise ValueError(f"Unknown sampling method: {method}")
+
+
+def inverse_cdf(spec, u):
+    # ('uniform', low, high), ('loguniform', low, high), ('normal', mean, sd) or
+    # ('lognormal', median, sd of the log)
+    kind, first, second = spec
+    u = np.clip(u, 1e-12, 1 - 1e-12)
+    if kind == 'uniform':
+        return first + u * (second - first)
+    if kind == 'loguniform':
+        return np.exp(np.log(first) + u * (np.log(second) - np.log(first)))
+    if kind == 'normal':
+        return first + second * ndtri(u)
+    if kind == 'lognormal':
+        return first * np.exp(second * ndtri(u))
+    raise ValueError(f"Unknown distribution: {kind}")
+
+
+def draw_samples(distributions, count, method='lhs', seed=None):
+    names = list(distributions)
+    u = unit_samples(count, len(names), method, seed)
+    return {name: inverse_cdf(distributions[name], u[:, i]) for i, name in enumerate(names)}
+
+
+class P2Quantiles:
+    # Streaming percentiles of a series at every time point with the P-square algorithm
+    # (Jain & Chlamtac): five markers per percentile and point, updated one sample at a time,
+    # so memory does not grow with the number of samples. Markers have shape (percentiles, 5, n)
+    def __init__(self, percentiles, n):
+        self.p = np.asarray(percentiles, dtype=float)[:, None] / 100
+        self.count = 0
+        self._first = np.empty((5, n))
+        self.heights = None
+        self.positions = None
+        self.desired = None
+        self.increments = np.stack([np.zeros_like(self.p), self.p / 2, self.p, (1 + self.p) / 2,
+                                    np.ones_like(self.p)], axis=1)
+
+    def update(self, samples):
+        for x in np.atleast_2d(samples):
+            self._update(x)
+
+    def _update(self, x):
+        if self.count < 5:
+            self._first[self.count] = x
+            self.count += 1
+            if self.count == 5:
+                n_p = len(self.p)
+                self.heights = np.repeat(np.sort(self._first, axis=0)[None], n_p, axis=0)
+                self.positions = np.broadcast_to(np.arange(1.0, 6.0)[None, :, None], self.heights.shape).copy()
+                self.desired = np.broadcast_to(1 + 4 * self.increments, self.heights.shape).copy()
+            return
+        self.count += 1
+        q, pos = self.heights, self.positions
+        np.minimum(q[:, 0], x, out=q[:, 0])
+        np.maximum(q[:, 4], x, out=q[:, 4])
+        cell = (x >= q[:, 1]).astype(int) + (x >= q[:, 2]) + (x >= q[:, 3])
+        pos += np.arange(5)[None, :, None] > cell[:, None, :]
+        self.desired += self.increments
+
+        for i in (1, 2, 3):
+            d = self.desired[:, i] - pos[:, i]
+            step = np.where((d >= 1) & (pos[:, i+1] - pos[:, i] > 1), 1.0,
+                            np.where((d <= -1) & (pos[:, i-1] - pos[:, i] < -1), -1.0, 0.0))
+            if not step.any():
+                continue
+            # Piecewise-parabolic prediction, linear where it would leave the neighbouring markers
+            span = pos[:, i+1] - pos[:, i-1]
+            parabolic = q[:, i] + step / span * (
+                (pos[:, i] - pos[:, i-1] + step) * (q[:, i+1] - q[:, i]) / (pos[:, i+1] - pos[:, i]) +
+                (pos[:, i+1] - pos[:, i] - step) * (q[:, i] - q[:, i-1]) / (pos[:, i] - pos[:, i-1]))
+            neighbour = np.where(step > 0, i + 1, i - 1)
+            q_next = np.take_along_axis(q, neighbour[:, None], axis=1)[:, 0]
+            pos_next = np.take_along_axis(pos, neighbour[:, None], axis=1)[:, 0]
+            linear = q[:, i] + step * (q_next - q[:, i]) / (pos_next - pos[:, i])
+            inside = (q[:, i-1] < parabolic) & (parabolic < q[:, i+1])
+            moved = step != 0
+            q[:, i] = np.where(moved, np.where(inside, parabolic, linear), q[:, i])
+            pos[:, i] += step
+
+    def values(self):
+        # Exact percentiles while fewer than five samples have been seen
+        if self.count < 5:
+            return np.percentile(self._first[:self.count], self.p[:, 0] * 100, axis=0)
+        return self.heights[:, 2].copy()
+
+
+class RunningMoments:
+    # Mean, variance, minimum and maximum merged chunk by chunk (Chan et al.)
+    def __init__(self, n):
+        self.count = 0
+        self.mean = np.zeros(n)
+        self.m2 = np.zeros(n)
+        self.min = np.full(n, np.inf)
+        self.max = np.full(n, -np.inf)
+
+    def update(self, samples):
+        samples = np.atleast_2d(samples)
+        count = len(samples)
+        mean = samples.mean(axis=0)
+        m2 = ((samples - mean) ** 2).sum(axis=0)
+        total = self.count + count
+        delta = mean - self.mean
+        self.mean += delta * count / total
+        self.m2 += m2 + delta ** 2 * self.count * count / total
+        self.count = total
+        np.minimum(self.min, samples.min(axis=0), out=self.min)
+        np.maximum(self.max, samples.max(axis=0), out=self.max)
+
+    def std(self):
+        return np.sqrt(self.m2 / (self.count - 1)) if self.count > 1 else np.zeros_like(self.mean)
+
+
+def _run_chunk(params, protocol, feedback, output, members, spec=None):
+    install_protocol(spec)
+    results = ConstrainedMixtureModel(params).simulate_batch(members, protocol, feedback)
+    return np.asarray(results[output], dtype=float)
+
+
+def propagate(params, protocol, distributions, samples=1000, method='lhs', feedback=False,
+              percentiles=DEFAULT_PERCENTILES, output='sigma_total', chunk_size=UQ_CHUNK_SIZE,
+              jobs=1, seed=None):
+    # Samples the parameters in `distributions` ({name: (kind, a, b)}), runs them as batches of
+    # chunk_size and reduces every chunk to running percentiles and moments of `output` as it
+    # arrives. Only the chunks in flight are held, never the full set of trajectories
+    params = dict(params or {})
+    drawn = draw_samples(distributions, samples, method, seed)
+    members = [{name: float(values[i]) for name, values in drawn.items()} for i in range(samples)]
+    chunks = [members[start:start + chunk_size] for start in range(0, samples, chunk_size)]
+
+    time = ConstrainedMixtureModel(params)._time_grid(protocol)
+    quantiles = P2Quantiles(percentiles, len(time))
+    moments = RunningMoments(len(time))
+
+    spec = protocol_spec(protocol)
+
+    def reduce(values):
+        quantiles.update(values)
+        moments.update(values)
+
+    jobs = jobs or os.cpu_count() or 1
+    if jobs <= 1 or len(chunks) <= 1:
+        for chunk in chunks:
+            reduce(_run_chunk(params, protocol, feedback, output, chunk, spec))
+    else:
+        # Reduced in submission order, so the result does not depend on worker timing
+        with ProcessPoolExecutor(max_workers=min(jobs, len(chunks))) as pool:
+            pending = deque()
+            for chunk in chunks:
+                pending.append(pool.submit(_run_chunk, params, protocol, feedback, output, chunk, spec))
+                if len(pending) >= jobs * CHUNKS_IN_FLIGHT:
+                    reduce(pending.popleft().result())
+            while pending:
+                reduce(pending.popleft().result())
+
+    return {
+        'time': time,
+        'percentiles': np.asarray(percentiles, dtype=float),
+        'bands': quantiles.values(),
+        'mean': moments.mean,
+        'std': moments.std(),
+        'min': moments.min,
+        'max': moments.max,
+        'samples': samples,
+        'params': drawn
+    }
@@ -1,25 +1,34 @@
 import sys
 import argparse
-from ui.gui import CMMGUI
+import multiprocessing
 import os
 
-os.environ['QT_QPA_PLATFORM_PLUGIN_PATH'] = 'C:/Users/Карина/AppData/Local/Packages/PythonSoftwareFoundation.Python.3.10_qbz5n2kfra8p0/LocalCache/local-packages/Python310/site-packages/PyQt5/Qt5/plugins'
+QT_PLUGIN_PATH = 'C:/Users/Карина/AppData/Local/Packages/PythonSoftwareFoundation.Python.3.10_qbz5n2kfra8p0/LocalCache/local-packages/Python310/site-packages/PyQt5/Qt5/plugins'
 
 def main():
-    parser = argparse.ArgumentParser(description="Constrained Mixture Model Simulator")
+    multiprocessing.freeze_support()
+    # The CLI parses the remaining arguments itself, so --help is only answered here in GUI mode
+    parser = argparse.ArgumentParser(description="Constrained Mixture Model Simulator", add_help=False)
     parser.add_argument('--mode', choices=['gui', 'cli'], default='gui',
                       help='Launch mode: gui (graphical) or cli (command)')
     
-    args = parser.parse_args()
+    args, rest = parser.parse_known_args()
 
     if args.mode == 'gui':
+        if '-h' in rest or '--help' in rest:
+            parser.print_help()
+            return
+        # PyQt5 and the matplotlib Qt backend are only loaded for the GUI
+        os.environ['QT_QPA_PLATFORM_PLUGIN_PATH'] = QT_PLUGIN_PATH
         from PyQt5.QtWidgets import QApplication
+        from ui.gui import CMMGUI
         app = QApplication(sys.argv)
         window = CMMGUI()
         window.show()
         sys.exit(app.exec_())
     else:
         from ui.cli import main as cli_main
+        sys.argv = [sys.argv[0]] + rest
         cli_main()
 
 if __name__ == "__main__":
@@ -1,7 +1,9 @@
 import argparse
-import matplotlib.pyplot as plt
+import sys
+import time
 import numpy as np
 from core.models import ConstrainedMixtureModel
+from core.results import SimulationResults
 
 def parse_arguments():
     parser = argparse.ArgumentParser(
@@ -10,11 +12,51 @@ def parse_arguments():
     )
     
     parser.add_argument('protocol', 
-                      choices=['constant', 'linear', 'cyclic', 'all'],
-                      help="Loading protocol type")
+                      choices=['constant', 'linear', 'cyclic', 'file', 'all'],
+                      help="Loading protocol type ('file' reads the stretch history from --stretch_file)")
     parser.add_argument('--feedback', action='store_true',
                       help="Activate mechanical feedback")
+    add_model_arguments(parser)
     
+    output = parser.add_argument_group('Output Settings')
+    output.add_argument('--save', type=str,
+                      help="Save results to file (no extension)")
+    output.add_argument('--format', nargs='+', choices=['npz', 'csv', 'cmm', 'png'], default=['npz', 'csv'],
+                      help="Formats written with --save; cmm is the columnar binary format that "
+                           "core.storage.ColumnarResults memory-maps, png a stress plot (loads matplotlib). "
+                           "With 'all', every protocol gets its own <save>_<protocol> files")
+    output.add_argument('--quiet', action='store_true',
+                      help="Don't show progress")
+    output.add_argument('--stream', action='store_true',
+                      help="Write results in blocks to <save>[_<protocol>]/ while the simulation runs "
+                           "instead of keeping them in memory (requires --save)")
+    output.add_argument('--chunk_size', type=int, default=10000,
+                      help="Time steps per block written with --stream")
+    
+    periodic = parser.add_argument_group('Periodic steady state')
+    periodic.add_argument('--periodic', action='store_true',
+                        help="Resolve cycles until the response is periodic, then extrapolate its slow "
+                             "drift over many cycles at once; results are cycle means (cyclic or "
+                             "periodic --stretch_file protocols)")
+    periodic.add_argument('--points_per_cycle', type=int, default=64,
+                        help="Time steps per resolved cycle with --periodic")
+    
+    args = parser.parse_args()
+    if args.stream and not args.save:
+        parser.error("--stream requires --save")
+    if args.periodic and (args.stream or args.protocol == 'all'):
+        parser.error("--periodic runs one protocol in memory (no 'all', no --stream)")
+    if args.protocol == 'file' and not args.stretch_file:
+        parser.error("protocol 'file' requires --stretch_file")
+    return args
+
+def worker_count(text):
+    jobs = int(text)
+    if jobs < 0:
+        raise argparse.ArgumentTypeError(f"must be 0 (all cores) or a positive number of processes, not {jobs}")
+    return jobs
+
+def add_model_arguments(parser):
     material = parser.add_argument_group('Material parameters')
     material.add_argument('--c_c', type=float, default=1.0,
                         help="Collagen stiffness [kPa]")
@@ -54,6 +96,12 @@ def parse_arguments():
                         help="Growth rate parameter (for linear/cyclic)")
     protocol.add_argument('--lambda_roof', type=float, default=1.1,
                         help="Basic fabric stretch")
+    protocol.add_argument('--omega', type=float, default=np.pi,
+                        help="Angular frequency of the cyclic stretch [rad/day]")
+    protocol.add_argument('--stretch_file', type=str,
+                        help="CSV with the stretch history (time, stretch) of the 'file' protocol")
+    protocol.add_argument('--period', type=float,
+                        help="Repeat the --stretch_file history with this period [days]")
     
     sim = parser.add_argument_group('Simulation parameters')
     sim.add_argument('--t_end', type=float, default=10.0,
@@ -62,14 +110,239 @@ def parse_arguments():
                    help="Number of sampling points")
     sim.add_argument('--epsilon', type=float, default=1e-4,
                    help="Iteration convergence criterion")
+    sim.add_argument('--integration', choices=['auto', 'analytic', 'quad', 'incremental'], default='auto',
+                   help="Hereditary integral evaluation: closed forms where they exist (constant, "
+                        "linear) and quadrature otherwise, closed forms only, adaptive quadrature at "
+                        "every step, or the O(n) recursive update for exponential kernels")
+    sim.add_argument('--feedback_mode', choices=['recursive', 'reference'], default='recursive',
+                   help="Feedback history sums: carried recursively (O(n)) or rebuilt at every "
+                        "iteration as a reference (O(n^2))")
+    sim.add_argument('--feedback_solver', choices=['picard', 'anderson', 'newton'], default='picard',
+                   help="Iteration of each feedback step: plain fixed point, Anderson-accelerated, "
+                        "or Newton with the analytic Jacobian; anderson and newton need "
+                        "--feedback_mode recursive, the reference mode only runs picard")
+    sim.add_argument('--max_iter', type=int, default=20,
+                   help="Iteration limit of each feedback step")
+    sim.add_argument('--time_grid', choices=['uniform', 'adaptive'], default='uniform',
+                   help="Time grid: n_points evenly spaced points, or steps placed to follow "
+                        "the variation of the loading (n_points is then ignored)")
+    sim.add_argument('--grid_tol', type=float, default=1e-3,
+                   help="Relative interpolation tolerance of the adaptive grid")
+    sim.add_argument('--jobs', type=worker_count, default=1,
+                   help="Worker processes for running protocols in parallel (0 = all cores)")
+    sim.add_argument('--cache_dir', type=str,
+                   help="Reuse results of identical earlier runs stored in this directory")
+    sim.add_argument('--profile', action='store_true',
+                   help="Report time per phase, quadrature calls and feedback iterations")
+    sim.add_argument('--dtype', choices=['float64', 'float32'], default='float64',
+                   help="Storage of the result series; float32 halves their memory, the "
+                        "computation stays in float64")
+
+def parse_fit_arguments(argv):
+    from core.fitting import FIT_PARAMS
     
-    output = parser.add_argument_group('Output Settings')
-    output.add_argument('--save', type=str,
-                      help="Save results to file (no extension)")
-    output.add_argument('--quiet', action='store_true',
+    parser = argparse.ArgumentParser(
+        prog="cli fit",
+        description="Fit model parameters to a measured stress curve; the other model "
+                    "parameters are held at the values given",
+        formatter_class=argparse.ArgumentDefaultsHelpFormatter
+    )
+    parser.add_argument('data',
+                      help="Measurements: CSV with 'time' and 'stress' (or 'sigma_total') columns, "
+                           "a two-column CSV time,stress, or an .npz saved with --save")
+    parser.add_argument('--protocol', choices=['constant', 'linear', 'cyclic', 'file'], default='cyclic',
+                      help="Loading protocol of the experiment ('file' reads --stretch_file)")
+    parser.add_argument('--feedback', action='store_true',
+                      help="Activate mechanical feedback")
+    add_model_arguments(parser)
+    
+    fitting = parser.add_argument_group('Fit settings')
+    fitting.add_argument('--fit_params', nargs='+', default=list(FIT_PARAMS),
+                       help="Parameters to fit; their values above are the first start")
+    fitting.add_argument('--starts', type=int, default=1,
+                       help="Multi-start candidates; the others are drawn around the first one")
+    fitting.add_argument('--seed', type=int,
+                       help="Random seed of the start candidates")
+    fitting.add_argument('--jacobian', choices=['sensitivity', '2-point', '3-point'], default='sensitivity',
+                       help="Complex-step sensitivities from one batched run, or finite differences")
+    fitting.add_argument('--max_nfev', type=int,
+                       help="Evaluation limit of each start")
+    fitting.add_argument('--save', type=str,
+                       help="Write the fitted parameters and the cost of every start to this JSON file")
+    fitting.add_argument('--quiet', action='store_true',
+                       help="Only print the fitted parameters")
+    
+    args = parser.parse_args(argv)
+    if args.starts < 1:
+        parser.error("--starts must be at least 1")
+    if args.protocol == 'file' and not args.stretch_file:
+        parser.error("protocol 'file' requires --stretch_file")
+    args.t_end_given = any(arg.split('=')[0] == '--t_end' for arg in argv)
+    return args
+
+def parse_batch_arguments(argv):
+    parser = argparse.ArgumentParser(
+        prog="cli batch",
+        description="Run the parameter sets of a manifest without a display and write them to one file",
+        formatter_class=argparse.ArgumentDefaultsHelpFormatter
+    )
+    parser.add_argument('manifest',
+                      help="JSON or YAML parameter file as saved by the GUI, a list of them, or "
+                           "{'defaults': {...}, 'runs': [...]}; 'protocol' and 'feedback' may be set per run")
+    parser.add_argument('--output', type=str, required=True,
+                      help="Output file (no extension): <output>.cmm or .npz, plus .csv/.png on request")
+    parser.add_argument('--format', choices=['cmm', 'npz'], default='cmm',
+                      help="Columnar binary file (memory-mapped by core.storage.ColumnarResults) or .npz")
+    parser.add_argument('--feedback', action='store_true',
+                      help="Mechanical feedback for runs that do not set 'feedback'")
+    parser.add_argument('--jobs', type=worker_count, default=0,
+                      help="Worker processes (0 = all cores)")
+    parser.add_argument('--dtype', choices=['float64', 'float32'], default='float64',
+                      help="Storage of the result series")
+    parser.add_argument('--stretch_file', type=str,
+                      help="CSV with the stretch history (time, stretch) of the 'file' protocol")
+    parser.add_argument('--period', type=float,
+                      help="Repeat the --stretch_file history with this period [days]")
+    parser.add_argument('--csv', action='store_true',
+                      help="Also write <output>.csv with one row per run and time step")
+    parser.add_argument('--plot', action='store_true',
+                      help="Also write <output>.png with the total stress of every run")
+    parser.add_argument('--quiet', action='store_true',
                       help="Don't show progress")
+    return parser.parse_args(argv)
+
+def load_manifest(path):
+    with open(path) as f:
+        if path.endswith(('.yaml', '.yml')):
+            import yaml
+            manifest = yaml.safe_load(f)
+        else:
+            import json
+            manifest = json.load(f)
+    if isinstance(manifest, dict) and 'runs' in manifest:
+        defaults = manifest.get('defaults') or {}
+        return [{**defaults, **run} for run in manifest['runs']]
+    return [manifest] if isinstance(manifest, dict) else list(manifest)
+
+def run_batch(args):
+    import json
+    from core.models import BATCH_FIXED_PARAMS
+    from core.parallel import ParallelRunner
+    from core.results import RESULT_FIELDS
+    from core.storage import write_batch
+    
+    sets = load_manifest(args.manifest)
+    if not sets:
+        raise ValueError(f"No parameter sets in {args.manifest}")
+    # Sets sharing the protocol, the grid and solver settings and the names of their numeric
+    # overrides run as one vectorized sweep
+    groups = {}
+    for index, params in enumerate(sets):
+        protocol = params.get('protocol', 'cyclic')
+        feedback = bool(params.get('feedback', args.feedback))
+        overrides = {name: value for name, value in params.items() if name not in ('protocol', 'feedback')}
+        fixed = {name: value for name, value in overrides.items()
+                 if name in BATCH_FIXED_PARAMS or not isinstance(value, (int, float)) or isinstance(value, bool)}
+        varied = tuple(sorted(set(overrides) - set(fixed)))
+        # Lists and tables (a tabulated stretch, a time grid) are compared by their JSON text
+        key = (protocol, feedback, json.dumps(fixed, sort_keys=True, default=str), varied)
+        groups.setdefault(key, (fixed, []))[1].append(index)
     
-    return parser.parse_args()
+    runner = ParallelRunner(args.jobs)
+    runs = [None] * len(sets)
+    for number, ((protocol, feedback, _, varied), (fixed, indices)) in enumerate(groups.items()):
+        if not args.quiet:
+            print(f"Group {number + 1}/{len(groups)}: {len(indices)} run(s) of '{protocol}'"
+                  f"{' with feedback' if feedback else ''}")
+        base = {**fixed, 'dtype': args.dtype}
+        members = [{name: sets[index][name] for name in varied} for index in indices]
+        sweep = runner.run_sweep(base, members, protocol, feedback)
+        for row, index in enumerate(indices):
+            # Without varied parameters the sets are identical and share the one run
+            row = row if varied else 0
+            runs[index] = {'protocol': protocol, 'feedback': feedback, 'time': sweep['time'],
+                           'params': {name: value for name, value in sets[index].items()
+                                      if name not in ('protocol', 'feedback')},
+                           **{name: sweep[name][row] for name in RESULT_FIELDS if name != 'time'}}
+    
+    write_batch(f"{args.output}.{args.format}", runs)
+    written = [f"{args.output}.{args.format}"]
+    if args.csv:
+        import pandas as pd
+        frames = [pd.DataFrame({'run': i, **{name: run[name] for name in RESULT_FIELDS}})
+                  for i, run in enumerate(runs)]
+        pd.concat(frames, ignore_index=True).to_csv(f"{args.output}.csv", index=False)
+        written.append(f"{args.output}.csv")
+    if args.plot:
+        import matplotlib
+        matplotlib.use('Agg')
+        import matplotlib.pyplot as plt
+        plt.figure(figsize=(10, 6))
+        for i, run in enumerate(runs):
+            plt.plot(run['time'], run['sigma_total'], label=f"{i}: {run['protocol']}")
+        plt.xlabel('Time (days)')
+        plt.ylabel('Stress (kPa)')
+        if len(runs) <= 20:
+            plt.legend()
+        plt.grid(True)
+        plt.savefig(f"{args.output}.png", dpi=300)
+        plt.close()
+        written.append(f"{args.output}.png")
+    if not args.quiet:
+        print(f"{len(runs)} run(s) saved in {', '.join(written)}")
+    return runs
+
+def register_stretch_file(args):
+    # The 'file' protocol is registered before any model sees it
+    if args.stretch_file:
+        from core.protocols import load_table
+        load_table('file', args.stretch_file, args.period)
+
+def load_stress_data(path):
+    if path.endswith('.npz'):
+        with np.load(path) as data:
+            return data['time'], data['sigma_total']
+    table = np.genfromtxt(path, delimiter=',', names=True)
+    names = table.dtype.names or ()
+    if 'time' in names:
+        return table['time'], table['stress' if 'stress' in names else 'sigma_total']
+    table = np.loadtxt(path, delimiter=',', ndmin=2)
+    return table[:, 0], table[:, 1]
+
+def run_fit(args):
+    import json
+    from core.fitting import ParameterFit
+    
+    time_data, stress = load_stress_data(args.data)
+    params = vars(args).copy()
+    # Without --t_end the simulation ends at the last measurement
+    if not args.t_end_given:
+        params['t_end'] = float(np.max(time_data))
+    if not args.quiet:
+        print(f"\nFitting {', '.join(args.fit_params)} to {len(stress)} points of '{args.data}' "
+              f"(protocol '{args.protocol}', {args.starts} start(s))...")
+    
+    fitter = ParameterFit(params, args.protocol, time_data, stress, args.fit_params, args.feedback,
+                          jacobian=args.jacobian)
+    best = fitter.fit(args.starts, args.jobs, args.seed, args.max_nfev)
+    
+    if not args.quiet and len(best['starts']) > 1:
+        for i, run in enumerate(best['starts']):
+            print(f"  start {i}: cost = {run['cost']:.6g}, {run['evaluations']} evaluations, {run['message']}")
+    rms = np.sqrt(2 * best['cost'] / len(stress))
+    print(f"\nBest fit (cost = {best['cost']:.6g}, RMS residual = {rms:.4g} kPa):")
+    for name, value in best['params'].items():
+        print(f"  {name:<10} {value:.6g}")
+    
+    if args.save:
+        with open(args.save, 'w') as f:
+            json.dump({'params': best['params'], 'cost': best['cost'], 'success': best['success'],
+                       'starts': [{'x0': run['x0'].tolist(), 'params': run['params'], 'cost': run['cost'],
+                                   'success': run['success'], 'evaluations': run['evaluations']}
+                                  for run in best['starts']]}, f, indent=2)
+        if not args.quiet:
+            print(f"The fit is saved in {args.save}")
+    return best
 
 def run_simulation(params):
     if not params.quiet:
@@ -78,33 +351,112 @@ def run_simulation(params):
             print(f"Mechanical feedback: K_c+ = {params.K_cplus}")
     
     model = ConstrainedMixtureModel(vars(params))
+    if params.cache_dir:
+        from core.cache import ResultCache
+        model.cache = ResultCache(params.cache_dir)
     
-    if params.protocol == 'all':
-        results = model.simulate_all_protocols(feedback=params.feedback)
+    # Profiled runs stay in one block so that their stats cover the whole run
+    on_chunk = None if params.quiet or params.profile else live_status(params.t_end)
+    if params.periodic:
+        results = model.simulate_periodic(params.protocol, feedback=params.feedback,
+                                          points_per_cycle=params.points_per_cycle)
+        if not params.quiet:
+            print(f"{len(results['time'])} of {results['cycles_total']} cycles resolved")
+    elif params.protocol == 'all':
+        results = model.simulate_all_protocols(feedback=params.feedback, jobs=params.jobs, on_chunk=on_chunk)
     else:
-        results = model.simulate(params.protocol, feedback=params.feedback)
+        results = model.simulate(params.protocol, feedback=params.feedback, on_chunk=on_chunk)
     
     if not params.quiet:
-        print("Simulation completed successfully!")
+        print("\nSimulation completed successfully!")
         if params.protocol == 'all':
             for protocol, data in results.items():
                 print(f"{protocol}: final stress = {data['sigma_total'][-1]:.2f} kPa")
         else:
             print(f"Last value σ_c: {results['sigma_c'][-1]:.2f} kPa")
     
+    if params.profile:
+        if params.protocol == 'all':
+            for protocol, data in results.items():
+                print_profile(data.get('_stats'), protocol)
+        else:
+            print_profile(results.get('_stats'), params.protocol)
+    
     return results
 
-def save_results(results, base_filename):
-    np.savez(f"{base_filename}.npz", **results)
-    import pandas as pd
-    df = pd.DataFrame(results)
-    df.to_csv(f"{base_filename}.csv", index=False)
+def live_status(t_end, interval=0.2):
+    # Progress line rewritten in place as blocks finish, at most every `interval` seconds
+    last_print = [0.0]
+    
+    def on_chunk(partial):
+        now = time.perf_counter()
+        t = partial['time'][-1]
+        if now - last_print[0] < interval and t < t_end:
+            return
+        last_print[0] = now
+        print(f"  t = {t:.4g} / {t_end:g} days, σ_total = {partial['sigma_total'][-1]:.4g} kPa", end='\r')
+    
+    return on_chunk
+
+def print_profile(stats, protocol):
+    if stats is None:
+        print(f"\nProfile '{protocol}': not available (collected in worker processes)")
+        return
+    print(f"\nProfile '{protocol}':")
+    for name, seconds in stats['timers'].items():
+        print(f"  {name:<24} {seconds:10.4f} s")
+    for name, count in stats['counters'].items():
+        print(f"  {name:<24} {count:10d}")
+    iterations = stats['feedback_iterations']
+    if len(iterations):
+        print(f"  {'feedback iterations':<24} mean {iterations.mean():.2f}, max {iterations.max()} over {len(iterations)} steps")
+
+def stream_simulation(params):
+    from core.storage import ChunkedResultWriter
+    
+    protocols = ['constant', 'linear', 'cyclic'] if params.protocol == 'all' else [params.protocol]
+    model = ConstrainedMixtureModel(vars(params))
+    paths = []
+    for protocol in protocols:
+        path = params.save if len(protocols) == 1 else f"{params.save}_{protocol}"
+        if not params.quiet:
+            print(f"\nStreaming protocol '{protocol}' to {path}/ ...")
+        with ChunkedResultWriter(path, protocol, params.feedback, model.params) as writer:
+            last = None
+            for chunk in model.simulate_iter(protocol, params.feedback, params.chunk_size):
+                writer.write(chunk)
+                last = chunk
+                if not params.quiet:
+                    print(f"  t = {chunk['time'][-1]:.4g} / {params.t_end:g} days", end='\r')
+        if not params.quiet:
+            print(f"\n{protocol}: final stress = {last['sigma_total'][-1]:.2f} kPa")
+        paths.append(path)
+    return paths
+
+def save_results(results, base_filename, protocol=None, formats=('npz', 'csv'), feedback=False, params=None):
+    # One set of tables per protocol; the plot (and matplotlib) only when 'png' is asked for
+    runs = {protocol: results} if 'time' in results else results
+    for name, data in runs.items():
+        path = base_filename if 'time' in results else f"{base_filename}_{name}"
+        if not isinstance(data, SimulationResults):
+            data = SimulationResults.from_dict(data)
+        if 'npz' in formats:
+            data.to_npz(f"{path}.npz")
+        if 'csv' in formats:
+            data.to_csv(f"{path}.csv")
+        if 'cmm' in formats:
+            from core.storage import write_results
+            write_results(f"{path}.cmm", data, name, feedback, params)
+    if 'png' not in formats:
+        return
+    
+    import matplotlib.pyplot as plt
     plt.figure(figsize=(10, 6))
-    if isinstance(results, dict) and 'time' in results:  
+    if 'time' in results:
         plt.plot(results['time'], results['sigma_c'], label='Collagen')
         if 'sigma_e' in results:
             plt.plot(results['time'], results['sigma_e'], label='Elastin')
-        plt.title(f"Protocol: {args.protocol}")
+        plt.title(f"Protocol: {protocol}")
     else:  
         for protocol, data in results.items():
             plt.plot(data['time'], data['sigma_total'], 
@@ -119,8 +471,10 @@ def save_results(results, base_filename):
     plt.close()
 
 def plot_interactive(results, protocol):
+    import matplotlib.pyplot as plt
+    
     plt.figure(figsize=(10, 6))
-    if isinstance(results, dict) and 'time' in results:  
+    if 'time' in results:
         if 'sigma_c' in results:
             plt.plot(results['time'], results['sigma_c'], label='Collagen')
         if 'sigma_e' in results:
@@ -145,12 +499,33 @@ def plot_interactive(results, protocol):
     plt.show()
 
 def main():
+    if sys.argv[1:2] == ['fit']:
+        args = parse_fit_arguments(sys.argv[2:])
+        register_stretch_file(args)
+        run_fit(args)
+        return
+    if sys.argv[1:2] == ['batch']:
+        args = parse_batch_arguments(sys.argv[2:])
+        register_stretch_file(args)
+        run_batch(args)
+        return
+    
     args = parse_arguments()
+    register_stretch_file(args)
+    if args.stream:
+        paths = stream_simulation(args)
+        if not args.quiet:
+            print(f"The results are saved in {', '.join(p + '/' for p in paths)}")
+        return
+    
     results = run_simulation(args)
     if args.save:
-        save_results(results, args.save)
+        from core.constans import DEFAULT_PARAMS
+        params = {name: value for name, value in vars(args).items() if name in DEFAULT_PARAMS}
+        save_results(results, args.save, args.protocol, args.format, args.feedback, params)
         if not args.quiet:
-            print(f"The results are saved in {args.save}.[npz/csv/png]")
+            suffix = '_<protocol>' if args.protocol == 'all' else ''
+            print(f"The results are saved in {args.save}{suffix}.[{'/'.join(args.format)}]")
     
     if not args.quiet:
         plot_interactive(results, args.protocol)
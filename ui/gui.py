@@ -1,14 +1,110 @@
+import queue
 import sys
+from time import perf_counter
 import numpy as np
 from PyQt5.QtWidgets import (QApplication, QMainWindow, QTabWidget, QWidget, 
                             QVBoxLayout, QHBoxLayout, QPushButton, QLabel, 
                             QDoubleSpinBox, QComboBox, QGroupBox, QFileDialog,
                             QCheckBox, QFormLayout, QScrollArea, QSpinBox,
-                            QMessageBox)
-from PyQt5.QtCore import Qt
+                            QMessageBox, QProgressBar, QListWidget, QListWidgetItem)
+from PyQt5.QtCore import Qt, QThread, pyqtSignal
 from matplotlib.backends.backend_qt5agg import FigureCanvasQTAgg as FigureCanvas
 from matplotlib.figure import Figure
-from core.models import ConstrainedMixtureModel
+from core.models import ConstrainedMixtureModel, SimulationCancelled
+from core.cache import ResultCache
+from ui.plotting import DecimatedLines
+from ui.runs import scan_runs
+
+# Redraws per second of the live plot while a simulation runs
+LIVE_FPS = 10
+# The comparison legend is left out above this many lines
+LEGEND_MAX_ENTRIES = 20
+
+class SimulationThread(QThread):
+    progress = pyqtSignal(str, float, object)
+    completed = pyqtSignal(object)
+    cancelled = pyqtSignal()
+    failed = pyqtSignal(str)
+
+    def __init__(self, model, protocol, feedback, parent=None):
+        super().__init__(parent)
+        self.model = model
+        self.protocol = protocol
+        self.feedback = feedback
+
+    def run(self):
+        # The finished part of the results goes to the GUI at most LIVE_FPS times per second
+        t_end = self.model.params['t_end']
+        last_emit = [0.0]
+        
+        def on_chunk(partial):
+            now = perf_counter()
+            if now - last_emit[0] < 1.0 / LIVE_FPS:
+                return
+            last_emit[0] = now
+            fraction = partial['time'][-1] / t_end if t_end > 0 else 1.0
+            self.progress.emit(self.protocol, min(fraction, 1.0), partial)
+        
+        # Per-step progress as well: the reference feedback cannot carry state, so simulate runs it
+        # as one block and on_chunk only fires at the end. In blocked runs a step's fraction and
+        # partial results cover its block only, so there just its time is passed on
+        single_block = self.feedback and self.model.params['feedback_mode'] == 'reference'
+        
+        def on_step(phase, fraction, partial):
+            if single_block:
+                self.progress.emit(phase, fraction, partial)
+            elif partial is not None and len(partial.get('time', ())) and t_end > 0:
+                self.progress.emit(phase, min(partial['time'][-1] / t_end, 1.0), None)
+        
+        self.model.progress_callback = on_step
+        try:
+            results = self.model.simulate(self.protocol, feedback=self.feedback, on_chunk=on_chunk)
+        except SimulationCancelled:
+            self.cancelled.emit()
+        except Exception as e:
+            self.failed.emit(str(e))
+        else:
+            self.completed.emit(results)
+        finally:
+            self.model.progress_callback = None
+
+    def cancel(self):
+        self.model.cancel()
+
+class RunLoaderThread(QThread):
+    # Indexes result directories and reads decimated series of archived runs, one request at a
+    # time from a queue, so that the comparison tab stays responsive with hundreds of runs
+    indexed = pyqtSignal(str, object)
+    loaded = pyqtSignal(str, object, object)
+    failed = pyqtSignal(str, str)
+
+    def __init__(self, parent=None):
+        super().__init__(parent)
+        self.requests = queue.Queue()
+
+    def run(self):
+        while True:
+            request = self.requests.get()
+            if request is None:
+                return
+            kind, target = request
+            try:
+                if kind == 'index':
+                    self.indexed.emit(target, scan_runs(target))
+                else:
+                    time, values = target.load()
+                    self.loaded.emit(target.id, time, values)
+            except Exception as e:
+                self.failed.emit(target if kind == 'index' else target.id, str(e))
+
+    def index(self, directory):
+        self.requests.put(('index', directory))
+
+    def load(self, entry):
+        self.requests.put(('load', entry))
+
+    def stop(self):
+        self.requests.put(None)
 
 class CMMGUI(QMainWindow):
     def __init__(self):
@@ -17,7 +113,17 @@ class CMMGUI(QMainWindow):
         self.setGeometry(100, 100, 1400, 900)
         self.model = None
         self.results = {}
+        # The last run of each protocol is kept for the comparison tab; the cache only makes
+        # pressing Run again with unchanged parameters return at once
         self.all_results = {}
+        self.cache = ResultCache()
+        self.worker = None
+        # Run browser: entries of the indexed directory, their loaded (decimated) series and
+        # the entries being read
+        self.run_loader = None
+        self.archived_entries = {}
+        self.archived_series = {}
+        self.archived_pending = set()
         self.init_ui()
         self.setup_styles()
         
@@ -116,11 +222,20 @@ class CMMGUI(QMainWindow):
         btn_layout = QHBoxLayout()
         self.run_btn = QPushButton("Run the simulation")
         self.run_btn.clicked.connect(self.run_simulation)
+        self.cancel_btn = QPushButton("Cancel")
+        self.cancel_btn.clicked.connect(self.cancel_simulation)
+        self.cancel_btn.setEnabled(False)
         self.save_btn = QPushButton("Save settings")
         self.save_btn.clicked.connect(self.save_parameters)
         btn_layout.addWidget(self.run_btn)
+        btn_layout.addWidget(self.cancel_btn)
         btn_layout.addWidget(self.save_btn)
         layout.addLayout(btn_layout)
+        
+        self.progress_bar = QProgressBar()
+        self.progress_bar.setRange(0, 100)
+        self.progress_bar.setFormat("%p%")
+        layout.addWidget(self.progress_bar)
 
         scroll.setWidget(content)
         scroll.setWidgetResizable(True)
@@ -135,6 +250,11 @@ class CMMGUI(QMainWindow):
         
         self.figure = Figure(figsize=(10, 6))
         self.canvas = FigureCanvas(self.figure)
+        # The axes and their lines are kept; updates only swap the data
+        self.ax = self.figure.add_subplot(111)
+        self.ax.set_xlabel('Time (days)')
+        self.ax.grid(True, linestyle='--', alpha=0.6)
+        self.plot_lines = DecimatedLines(self.ax)
         
         control_layout = QHBoxLayout()
         self.plot_type = QComboBox()
@@ -173,8 +293,30 @@ class CMMGUI(QMainWindow):
         self.compare_group.setLayout(compare_layout)
         layout.addWidget(self.compare_group)
         
+        self.archive_group = QGroupBox("Saved runs")
+        archive_layout = QVBoxLayout()
+        archive_controls = QHBoxLayout()
+        self.open_runs_btn = QPushButton("Open results folder...")
+        self.open_runs_btn.clicked.connect(self.open_runs_directory)
+        archive_controls.addWidget(self.open_runs_btn)
+        self.archive_status = QLabel("No folder opened")
+        archive_controls.addWidget(self.archive_status, 1)
+        archive_layout.addLayout(archive_controls)
+        self.archive_list = QListWidget()
+        self.archive_list.setMaximumHeight(160)
+        self.archive_list.itemChanged.connect(self.on_archived_run_toggled)
+        archive_layout.addWidget(self.archive_list)
+        self.archive_group.setLayout(archive_layout)
+        layout.addWidget(self.archive_group)
+        
         self.compare_figure = Figure(figsize=(10, 6))
         self.compare_canvas = FigureCanvas(self.compare_figure)
+        self.compare_ax = self.compare_figure.add_subplot(111)
+        self.compare_ax.set_title("Comparison of stress by protocols", fontsize=12)
+        self.compare_ax.set_xlabel("Time (days)")
+        self.compare_ax.set_ylabel("Total stress (kPa)")
+        self.compare_ax.grid(True, linestyle='--', alpha=0.6)
+        self.compare_lines = DecimatedLines(self.compare_ax)
         layout.addWidget(self.compare_canvas)
         
         self.update_compare_btn = QPushButton("Update comparison")
@@ -240,100 +382,206 @@ class CMMGUI(QMainWindow):
         return params
 
     def run_simulation(self):
+        if self.worker is not None and self.worker.isRunning():
+            return
         try:
             params = self.get_current_parameters()
             self.model = ConstrainedMixtureModel(params)
-            
-            use_feedback = self.K_cplus_spin.value() > 0
-            protocol = params['protocol']
-    
-            if not hasattr(self, 'all_results'):
-                self.all_results = {}
-            
-            self.results = self.model.simulate(protocol, feedback=use_feedback)
-            self.all_results[protocol] = self.results
-            
-            self.update_plot()
-            self.tabs.setCurrentIndex(1)
-            
-            QMessageBox.information(
-                self, 
-                "Simulation completed", 
-                f"Calculation completed successfully!\n"
-                f"Protocol:{self._protocol_name(protocol)}\n"
-                f"Mechanical feedback: {'Yes' if use_feedback else 'No'}\n"
-                f"Final stress: {self.results['sigma_total'][-1]:.2f} kPa"
-            )
-            
+            self.model.cache = self.cache
         except Exception as e:
             QMessageBox.critical(
                 self, 
                 "Simulation error", 
                 f"Calculation failed:\n{str(e)}"
             )
+            return
+        
+        use_feedback = self.K_cplus_spin.value() > 0
+        protocol = params['protocol']
+        
+        self.results = {}
+        self.worker = SimulationThread(self.model, protocol, use_feedback, self)
+        self.worker.progress.connect(self.on_simulation_progress)
+        self.worker.completed.connect(
+            lambda results: self.on_simulation_completed(results, protocol, use_feedback))
+        self.worker.cancelled.connect(self.on_simulation_cancelled)
+        self.worker.failed.connect(self.on_simulation_failed)
+        self.worker.finished.connect(self.on_worker_finished)
+        
+        self.run_btn.setEnabled(False)
+        self.cancel_btn.setEnabled(True)
+        self.progress_bar.setValue(0)
+        self.progress_bar.setFormat(f"{self._protocol_name(protocol)}: %p%")
+        self.tabs.setCurrentIndex(1)
+        # Cleared here rather than in simulate, so a Cancel clicked before the thread gets there counts
+        self.model.reset_cancel()
+        self.worker.start()
+
+    def cancel_simulation(self):
+        if self.worker is not None and self.worker.isRunning():
+            self.worker.cancel()
+            self.cancel_btn.setEnabled(False)
+
+    def on_simulation_progress(self, phase, fraction, partial):
+        self.progress_bar.setFormat(f"{phase}: %p%")
+        self.progress_bar.setValue(int(100 * fraction))
+        if partial is not None and len(partial.get('time', ())) > 1:
+            self.results = partial
+            self.update_plot()
+
+    def on_simulation_completed(self, results, protocol, use_feedback):
+        self.results = results
+        self.all_results[protocol] = self.results
+        self.update_plot()
+        self.progress_bar.setValue(100)
+        
+        QMessageBox.information(
+            self, 
+            "Simulation completed", 
+            f"Calculation completed successfully!\n"
+            f"Protocol:{self._protocol_name(protocol)}\n"
+            f"Mechanical feedback: {'Yes' if use_feedback else 'No'}\n"
+            f"Final stress: {self.results['sigma_total'][-1]:.2f} kPa"
+        )
+
+    def on_simulation_cancelled(self):
+        self.progress_bar.setFormat("Cancelled at %p%")
+        QMessageBox.information(self, "Simulation cancelled", "The calculation was cancelled")
+
+    def on_simulation_failed(self, message):
+        QMessageBox.critical(
+            self, 
+            "Simulation error", 
+            f"Calculation failed:\n{message}"
+        )
+
+    def on_worker_finished(self):
+        self.run_btn.setEnabled(True)
+        self.cancel_btn.setEnabled(False)
+
+    def closeEvent(self, event):
+        if self.worker is not None and self.worker.isRunning():
+            self.worker.cancel()
+            self.worker.wait()
+        if self.run_loader is not None:
+            self.run_loader.stop()
+            self.run_loader.wait()
+        super().closeEvent(event)
+
+    # Series of each chart type: (result key, label)
+    PLOT_SERIES = {
+        "Component stress": [('sigma_c', 'Collagen'), ('sigma_e', 'Elastin'), ('sigma_g', 'Matrix')],
+        "Volume fractions": [('J_c', 'Collagen'), ('J_e', 'Elastin')]
+    }
 
     def update_plot(self):
         if not hasattr(self, 'results') or not self.results:
             return
             
-        self.figure.clear()
-        ax = self.figure.add_subplot(111)
         t = self.results['time']
-        
         plot_type = self.plot_type.currentText()
         protocol = self.get_current_parameters()['protocol']
         protocol_name = self._protocol_name(protocol)
         
+        # Lines are keyed by chart type, so switching types only changes what is visible
+        shown = []
+        for key, label in self.PLOT_SERIES.get(plot_type, []):
+            if key in self.results:
+                name = (plot_type, key)
+                self.plot_lines.set_data(name, t, self.results[key], label=label, linewidth=2)
+                shown.append(name)
+        self.plot_lines.show_only(shown)
+        
         if plot_type == "Component stress":
-            if 'sigma_c' in self.results:
-                ax.plot(t, self.results['sigma_c'], label='Collagen', linewidth=2)
-            if 'sigma_e' in self.results:
-                ax.plot(t, self.results['sigma_e'], label='Elastin', linewidth=2)
-            if 'sigma_g' in self.results:
-                ax.plot(t, self.results['sigma_g'], label='Matrix', linewidth=2)
-            
-            ax.set_title(f"Component stress\n{protocol_name}", fontsize=12)
-            ax.set_ylabel('Stress (kPa)')
-            ax.legend()
-            
+            self.ax.set_title(f"Component stress\n{protocol_name}", fontsize=12)
+            self.ax.set_ylabel('Stress (kPa)')
         elif plot_type == "Volume fractions":
-            if 'J_c' in self.results:
-                ax.plot(t, self.results['J_c'], label='Collagen', linewidth=2)
-            if 'J_e' in self.results:
-                ax.plot(t, self.results['J_e'], label='Elastin', linewidth=2)
-            if 'J_g' in self.results:
-                ax.plot(t, [self.params['Jg0']]*len(t), label='Matrix', linewidth=2)
-            
-            ax.set_title(f"Volume fractions companents\n{protocol_name}", fontsize=12)
-            ax.set_ylabel('Volume fraction')
-            ax.legend()
+            self.ax.set_title(f"Volume fractions companents\n{protocol_name}", fontsize=12)
+            self.ax.set_ylabel('Volume fraction')
+        else:
+            self.ax.set_title("")
+            self.ax.set_ylabel("")
         
-        ax.set_xlabel('Time (days)')
-        ax.grid(True, linestyle='--', alpha=0.6)
-        self.canvas.draw()
+        self.plot_lines.update_legend()
+        self.plot_lines.autoscale()
+        self.canvas.draw_idle()
+
+    def open_runs_directory(self):
+        directory = QFileDialog.getExistingDirectory(self, "Results folder")
+        if not directory:
+            return
+        if self.run_loader is None:
+            self.run_loader = RunLoaderThread(self)
+            self.run_loader.indexed.connect(self.on_runs_indexed)
+            self.run_loader.loaded.connect(self.on_archived_run_loaded)
+            self.run_loader.failed.connect(self.on_archived_run_failed)
+            self.run_loader.start()
+        self.archive_status.setText(f"Indexing {directory}...")
+        self.run_loader.index(directory)
+
+    def on_runs_indexed(self, directory, entries):
+        # Series already loaded stay cached; the list shows the new directory
+        self.archive_list.blockSignals(True)
+        self.archive_list.clear()
+        self.archived_entries = {entry.id: entry for entry in entries}
+        for entry in entries:
+            item = QListWidgetItem(entry.label)
+            item.setFlags(item.flags() | Qt.ItemIsUserCheckable)
+            item.setCheckState(Qt.Unchecked)
+            item.setData(Qt.UserRole, entry.id)
+            self.archive_list.addItem(item)
+        self.archive_list.blockSignals(False)
+        self.archive_status.setText(f"{len(entries)} run(s) in {directory}")
+        self.update_comparison_plot()
+
+    def on_archived_run_toggled(self, item):
+        run_id = item.data(Qt.UserRole)
+        if item.checkState() == Qt.Checked and run_id not in self.archived_series \
+                and run_id not in self.archived_pending:
+            self.archived_pending.add(run_id)
+            self.run_loader.load(self.archived_entries[run_id])
+        else:
+            self.update_comparison_plot()
+
+    def on_archived_run_loaded(self, run_id, time, values):
+        self.archived_pending.discard(run_id)
+        self.archived_series[run_id] = (time, values)
+        self.update_comparison_plot()
+
+    def on_archived_run_failed(self, target, message):
+        self.archived_pending.discard(target)
+        self.archive_status.setText(f"Could not read {target}: {message}")
+
+    def _checked_archived_runs(self):
+        items = (self.archive_list.item(row) for row in range(self.archive_list.count()))
+        return [item.data(Qt.UserRole) for item in items if item.checkState() == Qt.Checked]
 
     def update_comparison_plot(self):
-        self.compare_figure.clear()
-        ax = self.compare_figure.add_subplot(111)
-        
+        all_results = self.all_results
         selected_protocols = [p for p, cb in self.protocol_checks.items() 
-                            if cb.isChecked() and p in self.all_results]
+                            if cb.isChecked() and p in all_results]
         
         for protocol in selected_protocols:
-            data = self.all_results[protocol]
-            ax.plot(data['time'], data['sigma_total'], 
-                   label=self._protocol_name(protocol),
-                   linewidth=2)
-        
-        ax.set_title("Comparison of stress by protocols", fontsize=12)
-        ax.set_xlabel("Time (days)")
-        ax.set_ylabel("Total stress (kPa)")
-        ax.legend()
-        ax.grid(True, linestyle='--', alpha=0.6)
-        self.compare_canvas.draw()
+            data = all_results[protocol]
+            self.compare_lines.set_data(protocol, data['time'], data['sigma_total'],
+                                        label=self._protocol_name(protocol), linewidth=2)
+        shown = list(selected_protocols)
+        # Saved runs are drawn once their decimated series has arrived from the loader thread
+        for run_id in self._checked_archived_runs():
+            if run_id in self.archived_series:
+                name = ('saved', run_id)
+                self.compare_lines.set_data(name, *self.archived_series[run_id],
+                                            label=self.archived_entries[run_id].label, linewidth=1)
+                shown.append(name)
+        self.compare_lines.show_only(shown)
+        
+        self.compare_lines.update_legend(LEGEND_MAX_ENTRIES)
+        self.compare_lines.autoscale()
+        self.compare_canvas.draw_idle()
 
     def save_parameters(self):
-        params = self.get_current_parameters()
+        # The GUI runs feedback whenever K_cplus > 0; the flag is saved for the batch mode
+        params = {**self.get_current_parameters(), 'feedback': self.K_cplus_spin.value() > 0}
         filename, _ = QFileDialog.getSaveFileName(
             self, "Save settings", "", 
             "JSON Files (*.json);;All Files (*)"
@@ -0,0 +1,72 @@
+import numpy as np
+
+
+def decimate_minmax(x, y, bins):
+    # Keeps the smallest and largest y of each of `bins` equal index ranges, in their original
+    # order, plus both end points; peaks survive while the point count drops to ~2 * bins
+    n = len(x)
+    if bins <= 0 or n <= 2 * bins + 2:
+        return x, y
+    size = n // bins
+    body = y[:bins * size].reshape(bins, size)
+    offsets = np.arange(bins) * size
+    picks = [np.argmin(body, axis=1) + offsets, np.argmax(body, axis=1) + offsets]
+    if bins * size < n:
+        tail = y[bins * size:]
+        picks.append(np.array([bins * size + np.argmin(tail), bins * size + np.argmax(tail)]))
+    index = np.unique(np.concatenate(picks + [np.array([0, n - 1])]))
+    return x[index], y[index]
+
+
+class DecimatedLines:
+    # Line2D objects of one Axes, created once and reused. The full series is kept aside and the
+    # lines only hold a min/max decimation of the visible x range at the axes' pixel width,
+    # refreshed on zoom, pan and resize. x must be increasing
+    def __init__(self, ax):
+        self.ax = ax
+        self.lines = {}
+        self._data = {}
+        ax.callbacks.connect('xlim_changed', lambda ax: self.refresh())
+        ax.figure.canvas.mpl_connect('resize_event', lambda event: self.refresh())
+
+    def set_data(self, name, x, y, **style):
+        line = self.lines.get(name)
+        if line is None:
+            line, = self.ax.plot([], [], **style)
+            self.lines[name] = line
+        line.set_visible(True)
+        self._data[name] = (np.asarray(x, dtype=float), np.asarray(y, dtype=float))
+        self._decimate(name, None)
+
+    def show_only(self, names):
+        for name, line in self.lines.items():
+            line.set_visible(name in names)
+
+    def autoscale(self):
+        self.ax.relim(visible_only=True)
+        self.ax.set_autoscale_on(True)
+        self.ax.autoscale_view()
+
+    def update_legend(self, max_entries=None):
+        handles = [line for line in self.lines.values() if line.get_visible()]
+        legend = self.ax.get_legend()
+        if handles and (max_entries is None or len(handles) <= max_entries):
+            self.ax.legend(handles=handles)
+        elif legend is not None:
+            legend.remove()
+
+    def refresh(self):
+        xlim = self.ax.get_xlim()
+        for name, line in self.lines.items():
+            if line.get_visible():
+                self._decimate(name, xlim)
+
+    def _decimate(self, name, xlim):
+        x, y = self._data[name]
+        if xlim is not None and len(x):
+            # One point beyond each edge keeps the line running off the axes
+            start = max(np.searchsorted(x, min(xlim)) - 1, 0)
+            stop = np.searchsorted(x, max(xlim), side='right') + 1
+            x, y = x[start:stop], y[start:stop]
+        bins = max(1, int(self.ax.bbox.width))
+        self.lines[name].set_data(*decimate_minmax(x, y, bins))
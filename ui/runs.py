@@ -0,0 +1,124 @@
+import json
+import os
+import zipfile
+import numpy as np
+from core.storage import MANIFEST, ColumnarResults, read_chunked_results, read_columnar_header, read_manifest
+from ui.plotting import decimate_minmax
+
+# Points per series the run browser keeps; the comparison plot decimates further to its width
+BROWSER_POINTS = 4000
+
+
+class RunEntry:
+    # One archived run: where it is stored and its metadata. The series are only read by load()
+    def __init__(self, path, kind, protocol=None, feedback=None, params=None, steps=None, row=None):
+        self.path = path
+        self.kind = kind
+        self.protocol = protocol
+        self.feedback = feedback
+        self.params = params or {}
+        self.steps = steps
+        # Run of a batch file
+        self.row = row
+        self.id = path if row is None else f"{path}#{row}"
+
+    @property
+    def label(self):
+        name = os.path.basename(os.path.normpath(self.path))
+        if self.row is not None:
+            name += f" [{self.row}]"
+        details = [self.protocol or 'unknown protocol']
+        if self.feedback:
+            details.append('feedback')
+        if self.steps is not None:
+            details.append(f"{self.steps} steps")
+        return f"{name} ({', '.join(details)})"
+
+    def load(self, field='sigma_total', points=BROWSER_POINTS):
+        # Min/max decimation of one series; columnar files are memory-mapped, so only the time and
+        # `field` columns are read
+        time, values = self._read(field)
+        return decimate_minmax(np.asarray(time, dtype=float), np.asarray(values, dtype=float), points // 2)
+
+    def _read(self, field):
+        if self.kind == 'cmm':
+            columns = ColumnarResults(self.path)
+            if self.row is None:
+                return columns['time'], columns[field]
+            return columns['time'][self.row, :self.steps], columns[field][self.row, :self.steps]
+        if self.kind == 'chunks':
+            series = read_chunked_results(self.path, ['time', field])
+            return series['time'], series[field]
+        # Members of an .npz are read one by one
+        with np.load(self.path) as data:
+            return data['time'], data[field]
+
+
+def scan_runs(directory):
+    # Runs under `directory`: .cmm files (one entry per run of a batch), .npz results with a time
+    # series (ResultCache entries with their .json metadata, --save output) and --stream block
+    # directories. Only headers and metadata are read; unreadable files are skipped
+    entries = []
+    for root, dirs, files in os.walk(directory):
+        dirs.sort()
+        if MANIFEST in files:
+            try:
+                manifest = read_manifest(root)
+                entries.append(RunEntry(root, 'chunks', manifest.get('protocol'), manifest.get('feedback'),
+                                        manifest.get('params'), manifest.get('steps')))
+            except (OSError, ValueError, KeyError):
+                pass
+            dirs[:] = []
+            continue
+        for name in sorted(files):
+            path = os.path.join(root, name)
+            try:
+                if name.endswith('.cmm'):
+                    entries.extend(_columnar_entries(path))
+                elif name.endswith('.npz') and not name.endswith('.tmp.npz'):
+                    entry = _npz_entry(path)
+                    if entry is not None:
+                        entries.append(entry)
+            except (OSError, ValueError, KeyError, zipfile.BadZipFile):
+                continue
+    return entries
+
+
+def _columnar_entries(path):
+    header, _ = read_columnar_header(path)
+    if 'runs' not in header:
+        return [RunEntry(path, 'cmm', header.get('protocol'), header.get('feedback'), header.get('params'),
+                         header['columns']['time']['shape'][-1])]
+    steps = header['columns']['time']['shape'][-1]
+    # The lengths of batch runs are a small column of their own
+    lengths = ColumnarResults(path)['steps'] if 'steps' in header['columns'] else [steps] * len(header['runs'])
+    return [RunEntry(path, 'cmm', run.get('protocol'), run.get('feedback'), run.get('params'), int(lengths[i]), i)
+            for i, run in enumerate(header['runs'])]
+
+
+def _npz_entry(path):
+    # The length comes from the .npy header of the time member, without reading the array
+    with zipfile.ZipFile(path) as archive:
+        if 'time.npy' not in archive.namelist():
+            return None
+        with archive.open('time.npy') as f:
+            version = np.lib.format.read_magic(f)
+            if version == (1, 0):
+                shape, _, _ = np.lib.format.read_array_header_1_0(f)
+            elif version == (2, 0):
+                shape, _, _ = np.lib.format.read_array_header_2_0(f)
+            else:
+                shape = None
+        if shape is None:
+            # No public header reader for later versions (3.0: UTF-8 field names); the time
+            # column is small enough to read
+            with archive.open('time.npy') as f:
+                shape = np.lib.format.read_array(f).shape
+    if len(shape) != 1:
+        return None
+    meta = {}
+    sidecar = path[:-len('.npz')] + '.json'
+    if os.path.exists(sidecar):
+        with open(sidecar) as f:
+            meta = json.load(f)
+    return RunEntry(path, 'npz', meta.get('protocol'), meta.get('feedback'), meta.get('params'), shape[0])